@@ -10,6 +10,10 @@
 #include <raaMaths/raaMaths.h>
 #include <raaMaths/raaVector.h>
 #include <raaSystem/raaSystem.h>
+#include <raaSystem/raaReorder.h>
+#include <raaSystem/raaSolver.h>
+#include <raaSystem/raaMultilevel.h>
+#include <raaSystem/raaSimulation.h>
 #include <raaPajParser/raaPajParser.h>
 #include <raaText/raaText.h>
 
@@ -32,9 +36,11 @@ raaControl g_Control; // set of flag controls used in my implmentation to retain
 
 // global var: parameter name for the file to load
 const static char csg_acFileParam[] = {"-input"};
+const static char csg_acBudgetParam[] = {"-budget"}; // ms of solver steps per position update
 
 // global var: file to load data from
 char g_acFile[256];
+float g_fFrameBudget = csg_fSolverFrameBudget;
 
 // core functions -> reduce to just the ones needed by glut as pointers to functions to fulfill tasks
 void display(); // The rendering function. This is called once for each frame and you should put rendering code here
@@ -58,6 +64,8 @@ void drawLabels(raaNode* pNode); //draws labels inside a mattrix
 // UI menu functions
 void createGlutMenu();
 void menu(int item);
+void menuSimulation(int item); // the part of a menu action that changes the system or solver, run on the simulation thread
+void simulationExit(); // stops the simulation thread, glut leaves through exit() so this runs from atexit
 
 // UI menu variables
 enum MENU_TYPE
@@ -68,7 +76,12 @@ enum MENU_TYPE
 	MENU_WORLD_SYSTEM_LAYOUT,
 	MENU_RANDOM_LAYOUT,
 	MENU_SPEED_UP,
-	MENU_SLOW_DOWN
+	MENU_SLOW_DOWN,
+	MENU_TOGGLE_REPULSION,
+	MENU_CYCLE_INTEGRATOR,
+	MENU_CYCLE_PRECISION,
+	MENU_TOGGLE_COLLISION,
+	MENU_MULTILEVEL_LAYOUT
 };
 MENU_TYPE currentItem = MENU_TOGGLE_GRID;
 static int menuId, submenuId;
@@ -79,102 +92,26 @@ void copyWorldSystemToCurrentPosition(raaNode* pNode);
 void copyDefaultToCurrentPosition(raaNode *pNode);
 void setWorldSystemPosition();
 
-// Spring primer functions
-void springPrimer();
-void resetResultantForce(raaNode *pNode);
-void deriveForces(raaArc *pArc);
-void deriveTranslation(raaNode *pNode);
+// Spring simulation variables
+raaSolver g_Solver; // spring solver, runs across all cores
+raaMultilevel g_Multilevel; // coarsened copies of g_System for the multilevel layout
+raaSimulation g_Simulation; // steps g_Solver on its own thread, owns the node positions while it runs
+const float *g_afFramePositions = 0; // positions snapshot drawn this frame, node store order
 
-// Spring primer variables
-const float DAMPING_COEF = 0.99995f;
-static float timeStep = 1.0f;
-
-void springPrimer()
+// position of a node in the frame being drawn
+float* framePosition(raaNode *pNode)
 {
-	if (solverToggle == 1)
-	{
-		// Step 1
-		visitNodes(&g_System, resetResultantForce);
-
-		// Step 2
-		visitArcs(&g_System, deriveForces);
-
-		// Step 3
-		visitNodes(&g_System, deriveTranslation);
-	}
-}
-
-void deriveForces(raaArc *pArc)
-{
-	raaNode *pNode_0 = pArc->m_pNode0;
-	raaNode *pNode_1 = pArc->m_pNode1;
-
-	// Resultant vector between 2 nodes and the magnitude of this vector
-	float resultantVector[3];
-	vecSub(pNode_1->m_afPosition, pNode_0->m_afPosition, resultantVector);
-	long double distance = vecLength(resultantVector);
-
-	// The unit vector derivation of the resultant vector
-	float resultantUnitVector[3];
-	for (int i = 0; i < 3; i++)
-		resultantUnitVector[i] = resultantVector[i] / distance;
-
-	// Extension through distance and base arc length and its 3D vector
-	float extension = distance - pArc->m_fIdealLen;
-	float extensionVector[3];
-	vecScalarProduct(resultantUnitVector, extension, extensionVector);
-
-	// Spring force vector = scalar product of extension vector with spring coefficient
-	float springForce_0[3];
-	vecScalarProduct(extensionVector, pArc->m_fSpringCoef, springForce_0);
-
-	// Spring force vector in the opposite direction for the second node
-	float springForce_1[3];
-	vecScalarProduct(springForce_0, -1.0f, springForce_1);
-
-	// Update resultant force
-	vecAdd(pNode_0->m_resultantForce, springForce_0, pNode_0->m_resultantForce);
-	vecAdd(pNode_1->m_resultantForce, springForce_1, pNode_1->m_resultantForce);
-}
-
-void deriveTranslation(raaNode *pNode)
-{
-	// Acceleration vector derived from force vector and mass
-	float acceleration[3];
-	for (int i = 0; i < 3; i++)
-		acceleration[i] = pNode->m_resultantForce[i] / pNode->m_fMass;
-
-	// Velocity vector for unit time = the sum of current velocity of the node and its acceleration, considering damping
-	float velocity[3];
-	for (int i = 0; i < 3; i++)
-		velocity[i] = (pNode->m_velocity[i] + acceleration[i]) * timeStep * (1 - DAMPING_COEF);
-
-	// New velocity set as current velocity for the node
-	vecCopy(velocity, pNode->m_velocity);
-	
-	// Translation of the node is equal to the current velocity divided by time
-	float displacement[3];
-	for (int i = 0; i < 3; i++)
-	{
-		displacement[i] = pNode->m_velocity[i] / timeStep;
-	}
-
-	vecAdd(pNode->m_afPosition, displacement, pNode->m_afPosition);
-}
-
-void resetResultantForce(raaNode *pNode)
-{
-	vecInit(pNode->m_resultantForce);
+	return g_afFramePositions && pNode->m_uiIndex < simulationNodes(&g_Simulation) ? (float*)g_afFramePositions + pNode->m_uiIndex * 4 : nodePosition(&g_System, pNode);
 }
 
 void copyDefaultToCurrentPosition(raaNode *pNode)
 {
-	vecCopy(pNode->m_defaultPosition, pNode->m_afPosition);
+	vecCopy(pNode->m_defaultPosition, nodePosition(&g_System, pNode));
 }
 
 void copyWorldSystemToCurrentPosition(raaNode* pNode)
 {
-	vecCopy(pNode->m_worldSystemPosition, pNode->m_afPosition);
+	vecCopy(pNode->m_worldSystemPosition, nodePosition(&g_System, pNode));
 }
 
 void setWorldSystemPosition()
@@ -184,9 +121,9 @@ void setWorldSystemPosition()
 	 * adjust x position based on world system unit,
 	 * adjust y position based on previous node position,
 	 */
-	for (raaLinkedListElement *pE = g_System.m_llNodes.m_pHead; pE; pE = pE->m_pNext)
+	for (unsigned int i = 0; i < g_System.m_Nodes.m_uiCount; i++)
 	{
-		raaNode *pNode = (raaNode*)pE->m_pData;
+		raaNode *pNode = g_System.m_Nodes.m_apNode[i];
 		pNode->m_worldSystemPosition[0] = 300.0f * pNode->m_uiWorldSystem;
 		
 		if (pNode->m_uiWorldSystem == 1)
@@ -212,7 +149,7 @@ void setWorldSystemPosition()
 
 void randomisePosition(raaNode* pNode)
 {
-	vecRand(100, 1000, pNode->m_afPosition);
+	vecRand(100, 1000, nodePosition(&g_System, pNode));
 }
 
 void createGlutMenu()
@@ -222,6 +159,7 @@ void createGlutMenu()
 	glutAddMenuEntry("Default", MENU_DEFAULT_LAYOUT);
 	glutAddMenuEntry("World System Layout", MENU_WORLD_SYSTEM_LAYOUT);
 	glutAddMenuEntry("Randomised Layout", MENU_RANDOM_LAYOUT);
+	glutAddMenuEntry("Multilevel Layout", MENU_MULTILEVEL_LAYOUT);
 
 	// Main menu entries
 	menuId = glutCreateMenu(menu);
@@ -229,42 +167,32 @@ void createGlutMenu()
 	glutAddMenuEntry("Toggle Solver", MENU_TOGGLE_SOLVER);
 	glutAddMenuEntry("Speed Up", MENU_SPEED_UP);
 	glutAddMenuEntry("Slow Down", MENU_SLOW_DOWN);
+	glutAddMenuEntry("Toggle Repulsion", MENU_TOGGLE_REPULSION);
+	glutAddMenuEntry("Cycle Integrator", MENU_CYCLE_INTEGRATOR);
+	glutAddMenuEntry("Cycle Precision", MENU_CYCLE_PRECISION);
+	glutAddMenuEntry("Toggle Collision", MENU_TOGGLE_COLLISION);
 	glutAddSubMenu("Switch Layouts", submenuId);
 	glutAttachMenu(GLUT_RIGHT_BUTTON);
 }
 
 void menu(int item)
 {
+	// the ui state changes here, everything touching the system or the solver is posted to the simulation thread so the
+	// window never waits on a solver step
 	switch (item)
 	{
 	case MENU_DEFAULT_LAYOUT:
-	{
-		visitNodes(&g_System, copyDefaultToCurrentPosition);
-		solverToggle = 0;
-		currentItem = (MENU_TYPE)item;
-	}
-	break;
 	case MENU_WORLD_SYSTEM_LAYOUT:
-	{
-		visitNodes(&g_System, copyWorldSystemToCurrentPosition);
-		solverToggle = 0;
-		currentItem = (MENU_TYPE)item;
-	}
-	break;
 	case MENU_RANDOM_LAYOUT:
-	{
-		visitNodes(&g_System, randomisePosition);
+	case MENU_MULTILEVEL_LAYOUT:
 		solverToggle = 0;
-		currentItem = (MENU_TYPE)item;
-	}
-	break;
+		break;
 	case MENU_TOGGLE_GRID:
 	{
 		if (gridToggle == 0)
 			gridToggle = 1;
 		else
 			gridToggle = 0;
-		currentItem = (MENU_TYPE)item;
 	}
 		break;
 	case MENU_TOGGLE_SOLVER:
@@ -273,33 +201,90 @@ void menu(int item)
 			solverToggle = 1;
 		else
 			solverToggle = 0;
-		currentItem = (MENU_TYPE)item;
 	}
 		break;
+	default:
+		break;
+	}
+	currentItem = (MENU_TYPE)item;
+
+	simulationSetRunning(&g_Simulation, solverToggle == 1);
+	simulationPost(&g_Simulation, [item]() { menuSimulation(item); });
+	glutPostRedisplay();
+}
+
+void menuSimulation(int item)
+{
+	switch (item)
+	{
+	case MENU_DEFAULT_LAYOUT:
+		visitNodes(&g_System, copyDefaultToCurrentPosition);
+		break;
+	case MENU_WORLD_SYSTEM_LAYOUT:
+		visitNodes(&g_System, copyWorldSystemToCurrentPosition);
+		break;
+	case MENU_RANDOM_LAYOUT:
+		visitNodes(&g_System, randomisePosition);
+		break;
+	case MENU_MULTILEVEL_LAYOUT:
+		// the whole hierarchy is laid out with the current solver settings before the next step
+		multilevelLayout(&g_Multilevel, &g_System, &g_Solver);
+		break;
 	case MENU_SPEED_UP:
 	{
-		timeStep -= 0.1;
-		currentItem = (MENU_TYPE)item;
+		// the legacy update moves further with a smaller step, the others with a larger one
+		if (g_Solver.m_uiIntegrator == csg_uiSolverIntegratorLegacy)
+			solverSetTimeStep(&g_Solver, g_Solver.m_fTimeStep - 0.1f);
+		else
+			solverSetTimeStep(&g_Solver, g_Solver.m_fTimeStep + 0.1f);
 	}
 		break;
 	case MENU_SLOW_DOWN:
 	{
-		timeStep += 0.1;
-		currentItem = (MENU_TYPE)item;
+		if (g_Solver.m_uiIntegrator == csg_uiSolverIntegratorLegacy)
+			solverSetTimeStep(&g_Solver, g_Solver.m_fTimeStep + 0.1f);
+		else
+			solverSetTimeStep(&g_Solver, g_Solver.m_fTimeStep - 0.1f);
+	}
+		break;
+	case MENU_TOGGLE_REPULSION:
+	{
+		// cycles off -> barnes-hut -> fast multipole
+		if (g_Solver.m_uiRepulsion == csg_uiSolverRepulsionNone)
+			g_Solver.m_uiRepulsion = csg_uiSolverRepulsionBarnesHut;
+		else if (g_Solver.m_uiRepulsion == csg_uiSolverRepulsionBarnesHut)
+			g_Solver.m_uiRepulsion = csg_uiSolverRepulsionFMM;
+		else
+			g_Solver.m_uiRepulsion = csg_uiSolverRepulsionNone;
+	}
+		break;
+	case MENU_CYCLE_INTEGRATOR:
+	{
+		// legacy -> euler -> verlet -> rk4 -> pbd, the new integrators run with the adaptive step (pbd needs none)
+		solverSetIntegrator(&g_Solver, (g_Solver.m_uiIntegrator + 1) % csg_uiSolverIntegrators);
+		g_Solver.m_bAdaptive = g_Solver.m_uiIntegrator != csg_uiSolverIntegratorLegacy;
+		solverSetTimeStep(&g_Solver, csg_fSolverDefaultTimeStep);
 	}
 		break;
+	case MENU_CYCLE_PRECISION:
+		// float -> mixed -> compensated -> double
+		solverSetPrecision(&g_Solver, (g_Solver.m_uiPrecision + 1) % csg_uiSolverPrecisions);
+		break;
+	case MENU_TOGGLE_COLLISION:
+		g_Solver.m_bCollision = !g_Solver.m_bCollision;
+		break;
 	default:
 		break;
 	}
 
-	glutPostRedisplay();
+	solverWake(&g_Solver); // layouts and solver settings all disturb a settled system
 }
 
 void setContinentNodeAttributes(raaNode *pNode)
 {
 	int continent = pNode->m_uiContinent;
 	int worldSystem = pNode->m_uiWorldSystem;
-	float* position = pNode->m_afPosition;
+	float* position = framePosition(pNode);
 	glTranslated(position[0], position[1], position[2]);
 	switch (continent)
 	{
@@ -342,7 +327,7 @@ void drawLabels(raaNode* pNode)
 {
 	glScalef(16.0f, 16.0f, 0.1f);
 	glTranslatef(0.0f, 1.50f, 0.0f);
-	outlinePrint(pNode->m_acName);
+	outlinePrint(nodeName(&g_System, pNode));
 }
 
 void nodeDisplay(raaNode *pNode) // function to render a node (called from display())
@@ -360,8 +345,8 @@ void arcDisplay(raaArc *pArc) // function to render an arc (called from display(
 {
 	// put your arc rendering (ogl) code here
 
-	raaNode* node0 = pArc->m_pNode0;
-	raaNode* node1 = pArc->m_pNode1;
+	float* position0 = framePosition(pArc->m_pNode0);
+	float* position1 = framePosition(pArc->m_pNode1);
 
 	glEnable(GL_COLOR_MATERIAL);
 	glDisable(GL_LIGHTING);
@@ -369,9 +354,9 @@ void arcDisplay(raaArc *pArc) // function to render an arc (called from display(
 	glBegin(GL_LINES);
 
 		glColor3f(0.0f, 1.0f, 0.0f);
-		glVertex3f(node0->m_afPosition[0], node0->m_afPosition[1], node0->m_afPosition[2]);
+		glVertex3f(position0[0], position0[1], position0[2]);
 		glColor3f(1.0f, 0.0f, 0.0f);
-		glVertex3f(node1->m_afPosition[0], node1->m_afPosition[1], node1->m_afPosition[2]);
+		glVertex3f(position1[0], position1[1], position1[2]);
 	
 	glEnd();
 }
@@ -387,6 +372,8 @@ void display()
 	// draw the grid if the control flag for it is true	
 	if (gridToggle == 1) glCallList(gs_uiGridDisplayList);
 
+	g_afFramePositions = simulationPositions(&g_Simulation); // latest positions the simulation thread has published, never waits
+
 	glPushAttrib(GL_ALL_ATTRIB_BITS); // push attribute state to enable constrained state changes
 	visitNodes(&g_System, nodeDisplay); // loop through all of the nodes and draw them with the nodeDisplay function
 	visitArcs(&g_System, arcDisplay); // loop through all of the arcs and draw them with the arcDisplay function
@@ -412,7 +399,7 @@ void idle()
 	controlChangeResetAll(g_Control); // re-set the update status for all of the control flags
 	camProcessInput(g_Input, g_Camera); // update the camera pos/ori based on changes since last render
 	camResetViewportChanged(g_Camera); // re-set the camera's viwport changed flag after all events have been processed
-	springPrimer(); // all spring based simulation functionality updating node position
+	if (solverToggle == 1 && simulationConverged(&g_Simulation)) Sleep(csg_uiIdleRestSleep); // layout has settled, give the cpu back
 	glutPostRedisplay();// ask glut to update the screen
 }
 
@@ -540,13 +527,30 @@ void myInit()
 	// initialise the data system and load the data file
 	initSystem(&g_System);
 	parse(g_acFile, parseSection, parseNetwork, parseArc, parsePartition, parseVector);
-	setWorldSystemPosition(); // sets world position on all nodes
+	printf("Merged %u repeated or reciprocal arcs\n", mergeArcs(&g_System, csg_uiArcMergeSum)); // one spring per node pair, summing keeps the forces unchanged
+	setWorldSystemPosition(); // sets world position on all nodes - uses file order so must run before the nodes are reordered
+	reorderSystem(&g_System, csg_uiReorderRCM); // renumber nodes and sort arcs for cache locality, also builds the topology for the solver
+	solverInit(&g_Solver);
+	g_Solver.m_bSleeping = true; // settled regions of the graph stop costing anything
+	multilevelInit(&g_Multilevel);
+	simulationInit(&g_Simulation, &g_System, &g_Solver); // spring simulation runs on its own thread from here, stopped until toggled
+	simulationSetFrameBudget(&g_Simulation, g_fFrameBudget); // as many steps as fit, then the positions are published
+
+	// atexit handlers run in reverse order, so creating the solver's pool first has the thread stopped before the pool
+	threadPoolDefault();
+	atexit(simulationExit);
+}
+
+void simulationExit()
+{
+	simulationDestroy(&g_Simulation);
 }
 
 int main(int argc, char* argv[])
 {
 	// check parameters to pull out the path and file name for the data file
 	for (int i = 0; i<argc; i++) if (!strcmp(argv[i], csg_acFileParam)) sprintf_s(g_acFile, "%s", argv[++i]);
+	for (int i = 0; i + 1<argc; i++) if (!strcmp(argv[i], csg_acBudgetParam)) g_fFrameBudget = (float)atof(argv[++i]);
 
 
 	if (strlen(g_acFile)) 
@@ -579,6 +583,10 @@ int main(int argc, char* argv[])
 		glutMainLoop(); // start the rendering loop running, this will only ext when the rendering window is closed 
 
 		killFont(); // cleanup the text rendering process
+		simulationDestroy(&g_Simulation);
+		multilevelDestroy(&g_Multilevel);
+		solverDestroy(&g_Solver);
+		destroySystem(&g_System); // release the node store, topology and pooled nodes/arcs
 
 		return 0; // return a null error code to show everything worked
 	}
@@ -12,6 +12,8 @@ const static unsigned int csg_uiDefaultStringLength = 128;
 const static float csg_fNearClip = 0.1f;
 const static float csg_fFarClip = 10000.0f;
 const static int csg_uiWindowDefinition[] = { 0,0,512,384 };
+const static unsigned int csg_uiIdleRestSleep = 15; // ms slept per idle call once the solver has converged
+const static float csg_fSolverFrameBudget = 12.0f; // ms of solver steps between position updates, leaves room for drawing
 // materials
 const static bool csg_bMaterialEmissiveOn = true;
 const static bool csg_bMaterialEmissiveOff = false;
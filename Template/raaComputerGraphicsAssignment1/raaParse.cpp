@@ -16,7 +16,13 @@ unsigned int g_uiParseCount = 0;
 
 void parseSection(const char* acRaw, const char* acSection, const char* acDescription, const char* acType, const char* acData) 
 {
-	if (!strcmp(acSection, "*Network")) g_uiParseMode = csg_uiParseNetwork;
+	if (!strcmp(acSection, "*Network"))
+	{
+		g_uiParseMode = csg_uiParseNetwork;
+
+		// "*Vertices n" follows the network header - size the node store and id index once rather than growing them per node
+		if (!strcmp(acType, "*Vertices")) reserveNodes(&g_System, (unsigned int)atoi(acData));
+	}
 	else if (!strcmp(acSection, "*Vector"))
 	{
 		g_uiParseMode = csg_uiParseVector;
@@ -39,7 +45,10 @@ void parseSection(const char* acRaw, const char* acSection, const char* acDescri
 void parseNetwork(const char* acRaw, const char* acId, const char* acName, const char* acY, const char* acZ) 
 {
 	float afPos[] = { 0.0f, (float)atof(acY)*csg_afParseLayoutScale[csg_uiY], (float)atof(acZ)*csg_afParseLayoutScale[csg_uiZ], 1.0f };
-	addNode(&g_System, initNode(new raaNode, atoi(acId), afPos, csg_fParseDefaultMass, acName));
+	raaNode *pNode = initNode(allocNode(&g_System), atoi(acId), afPos, csg_fParseDefaultMass);
+
+	nodeSetName(&g_System, pNode, acName);
+	addNode(&g_System, pNode);
 }
 
 void parseArc(const char* acRaw, const char* acId0, const char* acId1, const char* acStrength) 
@@ -47,7 +56,7 @@ void parseArc(const char* acRaw, const char* acId0, const char* acId1, const cha
 	raaNode *pN0 = nodeById(&g_System, atoi(acId0));
 	raaNode *pN1 = nodeById(&g_System, atoi(acId1));
 
-	if (pN0 && pN1) addArc(&g_System, initArc(new raaArc, pN0, pN1, (float)strtod(acStrength, NULL), csg_fParseDefaultSize));
+	if (pN0 && pN1) addArc(&g_System, initArc(allocArc(&g_System), pN0, pN1, (float)strtod(acStrength, NULL), csg_fParseDefaultSize));
 }
 
 void parsePartition(const char* acRaw, const char* acValue) 
@@ -76,7 +85,7 @@ void parseVector(const char* acRaw, const char* acValue)
 
 		if (pNode)
 		{
-			pNode->m_afPosition[csg_uiX] = fValue * 800.0f;
+			nodePosition(&g_System, pNode)[csg_uiX] = fValue * 800.0f;
 			pNode->m_defaultPosition[csg_uiX] = fValue * 800.0f;
 		}
 	}
@@ -84,6 +93,6 @@ void parseVector(const char* acRaw, const char* acValue)
 	{
 		raaNode *pNode = nodeById(&g_System, g_uiParseCount++);
 
-		if (pNode) pNode->m_fMass = fValue;
+		nodeSetMass(&g_System, pNode, fValue);
 	}
 }
@@ -0,0 +1,202 @@
+// headless batch layout - loads a pajek file, lays it out on every core until the solver converges or a step limit is
+// reached, and writes the final node positions. No window, opengl or windows headers, see the Makefile in this directory.
+//
+// raaHeadless -input <file.paj> -output <positions.txt> [-steps n] [-threads n] [-integrator legacy|euler|verlet|rk4|pbd]
+//             [-repulsion none|bh|fmm] [-precision float|mixed|compensated|double] [-multilevel] [-nosleep] [-deterministic]
+//             [-collision]
+//
+// The output has one line per node in id order: id "name" x y z
+// The summary on stdout ends with the rms arc length error, relative to the ideal lengths, of the final layout
+// With -deterministic the positions are bit identical for any -threads, see m_bDeterministic in raaSolver.h
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+
+#include <raaMaths/raaMaths.h>
+#include <raaSystem/raaSystem.h>
+#include <raaSystem/raaReorder.h>
+#include <raaSystem/raaSolver.h>
+#include <raaSystem/raaMultilevel.h>
+#include <raaPajParser/raaPajParser.h>
+
+#include "../raaComputerGraphicsAssignment1/raaParse.h"
+
+const static char csg_acFileParam[] = { "-input" };
+const static char csg_acOutputParam[] = { "-output" };
+const static char csg_acStepsParam[] = { "-steps" };
+const static char csg_acThreadsParam[] = { "-threads" };
+const static char csg_acIntegratorParam[] = { "-integrator" };
+const static char csg_acRepulsionParam[] = { "-repulsion" };
+const static char csg_acPrecisionParam[] = { "-precision" };
+const static char csg_acMultilevelParam[] = { "-multilevel" };
+const static char csg_acNoSleepParam[] = { "-nosleep" };
+const static char csg_acDeterministicParam[] = { "-deterministic" };
+const static char csg_acCollisionParam[] = { "-collision" };
+const static unsigned int csg_uiHeadlessDefaultSteps = 100000;
+
+raaSystem g_System; // filled by the parse callbacks shared with the viewer
+
+static void usage()
+{
+	fprintf(stderr, "usage: raaHeadless -input <file.paj> -output <positions.txt> [-steps n] [-threads n]\n");
+	fprintf(stderr, "                   [-integrator legacy|euler|verlet|rk4|pbd] [-repulsion none|bh|fmm] [-multilevel] [-nosleep]\n");
+	fprintf(stderr, "                   [-precision float|mixed|compensated|double] [-deterministic] [-collision]\n");
+}
+
+static float arcLengthError(raaSystem *pSystem)
+{
+	const raaTopology *pTopology = &(pSystem->m_Topology);
+	const float *afPosition = pSystem->m_Nodes.m_afPosition;
+	double dSum = 0.0;
+	unsigned int uiArcs = 0;
+
+	for (unsigned int uiArc = 0; uiArc < pTopology->m_uiArcCount; uiArc++)
+	{
+		const float *pfPosition0 = afPosition + pTopology->m_auiArcNode0[uiArc] * 4;
+		const float *pfPosition1 = afPosition + pTopology->m_auiArcNode1[uiArc] * 4;
+		float fIdeal = pTopology->m_afArcIdealLen[uiArc];
+
+		if (fIdeal > 0.0f)
+		{
+			double adDelta[3] = { pfPosition1[0] - pfPosition0[0], pfPosition1[1] - pfPosition0[1], pfPosition1[2] - pfPosition0[2] };
+			double dError = (sqrt(adDelta[0] * adDelta[0] + adDelta[1] * adDelta[1] + adDelta[2] * adDelta[2]) - fIdeal) / fIdeal;
+			dSum += dError * dError;
+			uiArcs++;
+		}
+	}
+	return uiArcs ? (float)sqrt(dSum / uiArcs) : 0.0f;
+}
+
+static bool writePositions(raaSystem *pSystem, const char *acFile)
+{
+	FILE *pFile = fopen(acFile, "w");
+	if (!pFile) return false;
+
+	std::vector<raaNode*> vNodes(pSystem->m_Nodes.m_apNode, pSystem->m_Nodes.m_apNode + pSystem->m_Nodes.m_uiCount);
+	std::sort(vNodes.begin(), vNodes.end(), [](const raaNode *pN0, const raaNode *pN1) { return pN0->m_uiId < pN1->m_uiId; });
+
+	for (unsigned int i = 0; i < vNodes.size(); i++)
+	{
+		const float *pfPosition = nodePosition(pSystem, vNodes[i]);
+		fprintf(pFile, "%u \"%s\" %.6g %.6g %.6g\n", vNodes[i]->m_uiId, nodeName(pSystem, vNodes[i]), pfPosition[0], pfPosition[1], pfPosition[2]);
+	}
+
+	bool bOk = !ferror(pFile);
+	return !fclose(pFile) && bOk;
+}
+
+int main(int argc, char* argv[])
+{
+	const char *acInput = 0, *acOutput = 0;
+	unsigned int uiSteps = csg_uiHeadlessDefaultSteps, uiThreads = 0, uiIntegrator = csg_uiSolverIntegratorLegacy, uiRepulsion = csg_uiSolverRepulsionNone;
+	unsigned int uiPrecision = RAA_SOLVER_DEFAULT_PRECISION;
+	bool bMultilevel = false, bSleeping = true, bDeterministic = false, bCollision = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool bValue = i + 1 < argc;
+
+		if (!strcmp(argv[i], csg_acFileParam) && bValue) acInput = argv[++i];
+		else if (!strcmp(argv[i], csg_acOutputParam) && bValue) acOutput = argv[++i];
+		else if (!strcmp(argv[i], csg_acStepsParam) && bValue) uiSteps = (unsigned int)strtoul(argv[++i], 0, 10);
+		else if (!strcmp(argv[i], csg_acThreadsParam) && bValue) uiThreads = (unsigned int)strtoul(argv[++i], 0, 10);
+		else if (!strcmp(argv[i], csg_acIntegratorParam) && bValue)
+		{
+			const char *acName = argv[++i];
+			if (!strcmp(acName, "legacy")) uiIntegrator = csg_uiSolverIntegratorLegacy;
+			else if (!strcmp(acName, "euler")) uiIntegrator = csg_uiSolverIntegratorEuler;
+			else if (!strcmp(acName, "verlet")) uiIntegrator = csg_uiSolverIntegratorVerlet;
+			else if (!strcmp(acName, "rk4")) uiIntegrator = csg_uiSolverIntegratorRK4;
+			else if (!strcmp(acName, "pbd")) uiIntegrator = csg_uiSolverIntegratorPBD;
+			else { usage(); return 1; }
+		}
+		else if (!strcmp(argv[i], csg_acRepulsionParam) && bValue)
+		{
+			const char *acName = argv[++i];
+			if (!strcmp(acName, "none")) uiRepulsion = csg_uiSolverRepulsionNone;
+			else if (!strcmp(acName, "bh")) uiRepulsion = csg_uiSolverRepulsionBarnesHut;
+			else if (!strcmp(acName, "fmm")) uiRepulsion = csg_uiSolverRepulsionFMM;
+			else { usage(); return 1; }
+		}
+		else if (!strcmp(argv[i], csg_acPrecisionParam) && bValue)
+		{
+			const char *acName = argv[++i];
+			if (!strcmp(acName, "float")) uiPrecision = csg_uiSolverPrecisionFloat;
+			else if (!strcmp(acName, "mixed")) uiPrecision = csg_uiSolverPrecisionMixed;
+			else if (!strcmp(acName, "compensated")) uiPrecision = csg_uiSolverPrecisionCompensated;
+			else if (!strcmp(acName, "double")) uiPrecision = csg_uiSolverPrecisionDouble;
+			else { usage(); return 1; }
+		}
+		else if (!strcmp(argv[i], csg_acMultilevelParam)) bMultilevel = true;
+		else if (!strcmp(argv[i], csg_acNoSleepParam)) bSleeping = false;
+		else if (!strcmp(argv[i], csg_acDeterministicParam)) bDeterministic = true;
+		else if (!strcmp(argv[i], csg_acCollisionParam)) bCollision = true;
+		else { usage(); return 1; }
+	}
+
+	if (!acInput || !acOutput)
+	{
+		usage();
+		return 1;
+	}
+
+	FILE *pCheck = fopen(acInput, "r");
+	if (!pCheck)
+	{
+		fprintf(stderr, "raaHeadless: cannot open %s\n", acInput);
+		return 1;
+	}
+	fclose(pCheck);
+
+	initMaths();
+
+	// load exactly as the viewer does
+	initSystem(&g_System, false);
+	parse(acInput, parseSection, parseNetwork, parseArc, parsePartition, parseVector);
+	mergeArcs(&g_System, csg_uiArcMergeSum);
+	reorderSystem(&g_System, csg_uiReorderRCM);
+
+	raaThreadPool pool;
+	threadPoolInit(&pool, uiThreads);
+
+	raaSolver solver;
+	solverInit(&solver, true, &pool);
+	solverSetIntegrator(&solver, uiIntegrator);
+	solver.m_bAdaptive = uiIntegrator != csg_uiSolverIntegratorLegacy;
+	solver.m_uiRepulsion = uiRepulsion;
+	solverSetPrecision(&solver, uiPrecision);
+	solver.m_bSleeping = bSleeping;
+	solver.m_bDeterministic = bDeterministic;
+	solver.m_bCollision = bCollision;
+
+	auto tStart = std::chrono::steady_clock::now();
+	unsigned int uiStep = 0;
+
+	if (bMultilevel)
+	{
+		raaMultilevel multilevel;
+		multilevelInit(&multilevel);
+		multilevelLayout(&multilevel, &g_System, &solver);
+		multilevelDestroy(&multilevel);
+	}
+
+	solverWake(&solver);
+	for (; uiStep < uiSteps && !solverConverged(&solver); uiStep++) solverStep(&solver, &g_System);
+
+	double dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+	printf("%s: %u nodes, %u arcs, %u steps on %u threads in %.2fs, %s, arc length error %.3g\n", acInput, g_System.m_Nodes.m_uiCount, g_System.m_Topology.m_uiArcCount, uiStep, threadPoolThreads(&pool), dSeconds, solverConverged(&solver) ? "converged" : "step limit reached", arcLengthError(&g_System));
+
+	bool bWritten = writePositions(&g_System, acOutput);
+	if (!bWritten) fprintf(stderr, "raaHeadless: cannot write %s\n", acOutput);
+
+	solverDestroy(&solver);
+	threadPoolDestroy(&pool);
+	destroySystem(&g_System);
+
+	return bWritten ? 0 : 1;
+}
@@ -1,13 +1,153 @@
 #include "stdafx.h"
+#include <stdlib.h>
+#include <string.h>
 #include "raaLinkedList.h"
 
-void initList(raaLinkedList* pList, unsigned int uiType)
+// new does not honour the chunk alignment before c++17
+static raaLinkedListChunk* chunkCreate()
+{
+#ifdef _WIN32
+	raaLinkedListChunk *pChunk = (raaLinkedListChunk*)_aligned_malloc(sizeof(raaLinkedListChunk), csg_uiListChunkAlignment);
+#else
+	void *pMem = 0;
+	raaLinkedListChunk *pChunk = posix_memalign(&pMem, csg_uiListChunkAlignment, sizeof(raaLinkedListChunk)) ? 0 : (raaLinkedListChunk*)pMem;
+#endif
+	pChunk->m_uiCount = 0;
+	return pChunk;
+}
+
+static void chunkDestroy(raaLinkedListChunk *pChunk)
+{
+#ifdef _WIN32
+	_aligned_free(pChunk);
+#else
+	free(pChunk);
+#endif
+}
+
+static void chunkInsertDir(raaLinkedList *pList, unsigned int uiChunk, raaLinkedListChunk *pChunk)
+{
+	if (pList->m_uiChunks == pList->m_uiChunkCapacity)
+	{
+		unsigned int uiCapacity = pList->m_uiChunkCapacity ? pList->m_uiChunkCapacity * 2 : 8;
+		raaLinkedListChunk **apChunk = new raaLinkedListChunk*[uiCapacity];
+		if (pList->m_apChunk)
+		{
+			memcpy(apChunk, pList->m_apChunk, sizeof(raaLinkedListChunk*)*pList->m_uiChunks);
+			delete[] pList->m_apChunk;
+		}
+		pList->m_apChunk = apChunk;
+		pList->m_uiChunkCapacity = uiCapacity;
+	}
+	memmove(pList->m_apChunk + uiChunk + 1, pList->m_apChunk + uiChunk, sizeof(raaLinkedListChunk*)*(pList->m_uiChunks - uiChunk));
+	pList->m_apChunk[uiChunk] = pChunk;
+	pList->m_uiChunks++;
+}
+
+static void chunkRemoveDir(raaLinkedList *pList, unsigned int uiChunk)
+{
+	chunkDestroy(pList->m_apChunk[uiChunk]);
+	memmove(pList->m_apChunk + uiChunk, pList->m_apChunk + uiChunk + 1, sizeof(raaLinkedListChunk*)*(pList->m_uiChunks - uiChunk - 1));
+	pList->m_uiChunks--;
+}
+
+static unsigned int chunkDirIndex(raaLinkedList *pList, raaLinkedListChunk *pChunk)
+{
+	// searched from the tail as that is where most of the activity is
+	for (unsigned int i = pList->m_uiChunks; i > 0; i--) if (pList->m_apChunk[i - 1] == pChunk) return i - 1;
+	return pList->m_uiChunks;
+}
+
+// insert at position uiPos of pChunk (0 for an empty list), splitting a full chunk in two
+static void chunkInsert(raaLinkedList *pList, raaLinkedListChunk *pChunk, unsigned int uiPos, raaLinkedListElement *pElement)
+{
+	if (!pChunk)
+	{
+		pChunk = chunkCreate();
+		chunkInsertDir(pList, pList->m_uiChunks, pChunk);
+	}
+
+	bool bAppend = pChunk == pList->m_apChunk[pList->m_uiChunks - 1] && uiPos == pChunk->m_uiCount;
+
+	if (pChunk->m_uiCount == csg_uiListChunkSize)
+	{
+		raaLinkedListChunk *pNew = chunkCreate();
+		chunkInsertDir(pList, bAppend ? pList->m_uiChunks : chunkDirIndex(pList, pChunk) + 1, pNew);
+
+		if (bAppend)
+		{
+			pChunk = pNew;
+			uiPos = 0;
+		}
+		else
+		{
+			unsigned int uiHalf = csg_uiListChunkSize / 2;
+			pNew->m_uiCount = pChunk->m_uiCount - uiHalf;
+			memcpy(pNew->m_apElement, pChunk->m_apElement + uiHalf, sizeof(raaLinkedListElement*)*pNew->m_uiCount);
+			for (unsigned int i = 0; i < pNew->m_uiCount; i++) pNew->m_apElement[i]->m_pChunk = pNew;
+			pChunk->m_uiCount = uiHalf;
+
+			if (uiPos > uiHalf)
+			{
+				pChunk = pNew;
+				uiPos -= uiHalf;
+			}
+		}
+	}
+
+	memmove(pChunk->m_apElement + uiPos + 1, pChunk->m_apElement + uiPos, sizeof(raaLinkedListElement*)*(pChunk->m_uiCount - uiPos));
+	pChunk->m_apElement[uiPos] = pElement;
+	pChunk->m_uiCount++;
+	pElement->m_pChunk = pChunk;
+
+	if (!bAppend) pList->m_bPacked = false;
+}
+
+static void chunkErase(raaLinkedList *pList, raaLinkedListChunk *pChunk, unsigned int uiPos)
+{
+	bool bLast = pChunk == pList->m_apChunk[pList->m_uiChunks - 1];
+
+	pChunk->m_apElement[uiPos]->m_pChunk = 0;
+	memmove(pChunk->m_apElement + uiPos, pChunk->m_apElement + uiPos + 1, sizeof(raaLinkedListElement*)*(pChunk->m_uiCount - uiPos - 1));
+	pChunk->m_uiCount--;
+
+	if (!pChunk->m_uiCount) chunkRemoveDir(pList, bLast ? pList->m_uiChunks - 1 : chunkDirIndex(pList, pChunk));
+	else if (!bLast) pList->m_bPacked = false;
+
+	if (!pList->m_uiChunks) pList->m_bPacked = true;
+}
+
+// the element records its chunk so only that chunk is searched
+static bool chunkFind(raaLinkedListElement *pElement, raaLinkedListChunk *&pChunk, unsigned int &uiPos)
+{
+	pChunk = pElement->m_pChunk;
+	if (pChunk) for (uiPos = 0; uiPos < pChunk->m_uiCount; uiPos++) if (pChunk->m_apElement[uiPos] == pElement) return true;
+	return false;
+}
+
+static raaLinkedListChunk* chunkHead(raaLinkedList *pList)
+{
+	return pList->m_uiChunks ? pList->m_apChunk[0] : 0;
+}
+
+static raaLinkedListChunk* chunkTail(raaLinkedList *pList)
+{
+	return pList->m_uiChunks ? pList->m_apChunk[pList->m_uiChunks - 1] : 0;
+}
+
+void initList(raaLinkedList* pList, unsigned int uiType, bool bChunked)
 {
 	if(pList)
 	{
 		pList->m_pHead = 0;
 		pList->m_pTail = 0;
 		pList->m_uiType = uiType;
+		pList->m_uiCount = 0;
+		pList->m_bChunked = bChunked;
+		pList->m_bPacked = true;
+		pList->m_apChunk = 0;
+		pList->m_uiChunks = 0;
+		pList->m_uiChunkCapacity = 0;
 	}
 }
 
@@ -17,6 +157,20 @@ void destroyList(raaLinkedList* pList, raaListDeletor* pDeletor)
 	{
 		if(pDeletor) for(raaLinkedListElement *pE=pList->m_pHead;pE;pE=pE->m_pNext) pDeletor(pE);
 		while(pList->m_pHead) delete popTail(pList);
+
+		delete[] pList->m_apChunk;
+		pList->m_apChunk = 0;
+		pList->m_uiChunkCapacity = 0;
+	}
+}
+
+void clearList(raaLinkedList* pList)
+{
+	if (pList)
+	{
+		while (pList->m_uiChunks) chunkRemoveDir(pList, pList->m_uiChunks - 1);
+		delete[] pList->m_apChunk;
+		initList(pList, pList->m_uiType, pList->m_bChunked);
 	}
 }
 
@@ -28,6 +182,7 @@ raaLinkedListElement* initElement(raaLinkedListElement* pElement, void* pData, u
 		pElement->m_pLast = 0;
 		pElement->m_pData = pData;
 		pElement->m_uiType = uiType;
+		pElement->m_pChunk = 0;
 	}
 	return pElement;
 }
@@ -51,6 +206,8 @@ void pushHead(raaLinkedList* pList, raaLinkedListElement* pElement)
 		if (!pList->m_pTail) pList->m_pTail = pElement;
 		if (pList->m_pHead) pList->m_pHead->m_pLast = pElement;
 		pList->m_pHead = pElement;
+		pList->m_uiCount++;
+		if (pList->m_bChunked) chunkInsert(pList, chunkHead(pList), 0, pElement);
 	}
 }
 
@@ -62,6 +219,8 @@ void pushTail(raaLinkedList* pList, raaLinkedListElement* pElement)
 		if (!pList->m_pHead) pList->m_pHead = pElement;
 		if (pList->m_pTail) pList->m_pTail->m_pNext = pElement;
 		pList->m_pTail = pElement;
+		pList->m_uiCount++;
+		if (pList->m_bChunked) chunkInsert(pList, chunkTail(pList), pList->m_uiChunks ? chunkTail(pList)->m_uiCount : 0, pElement);
 	}
 }
 
@@ -77,25 +236,44 @@ raaLinkedListElement* tail(raaLinkedList* pList)
 
 unsigned count(raaLinkedList* pList)
 {
-	unsigned int uiCount = 0;
-	if(pList) for (raaLinkedListElement *pE = pList->m_pHead; pE; pE = pE->m_pNext, uiCount++);
-	return uiCount;
+	return pList ? pList->m_uiCount : 0;
 }
 
 raaLinkedListElement* item(raaLinkedList* pList, unsigned uiIndex)
 {
-	if (pList)
+	if (pList && uiIndex < pList->m_uiCount)
 	{
-		raaLinkedListElement *pE = pList->m_pHead;
-		if(pE) for (; pE&&uiIndex; pE = pE->m_pNext);
-		return pE;
+		if (pList->m_bChunked)
+		{
+			if (pList->m_bPacked) return pList->m_apChunk[uiIndex / csg_uiListChunkSize]->m_apElement[uiIndex % csg_uiListChunkSize];
+
+			for (unsigned int i = 0; i < pList->m_uiChunks; uiIndex -= pList->m_apChunk[i++]->m_uiCount)
+				if (uiIndex < pList->m_apChunk[i]->m_uiCount) return pList->m_apChunk[i]->m_apElement[uiIndex];
+		}
+		else
+		{
+			raaLinkedListElement *pE = pList->m_pHead;
+			for (; pE&&uiIndex; pE = pE->m_pNext, uiIndex--);
+			return pE;
+		}
 	}
 	return 0;
 }
 
 void visit(raaLinkedList* pList, raaListActor* pActor)
 {
-	if(pList && pActor) for (raaLinkedListElement *pE = pList->m_pHead; pE; pE = pE->m_pNext) pActor(pE);
+	if (pList && pActor)
+	{
+		if (pList->m_bChunked)
+		{
+			for (unsigned int i = 0; i < pList->m_uiChunks; i++)
+			{
+				raaLinkedListChunk *pChunk = pList->m_apChunk[i];
+				for (unsigned int j = 0; j < pChunk->m_uiCount; j++) pActor(pChunk->m_apElement[j]);
+			}
+		}
+		else for (raaLinkedListElement *pE = pList->m_pHead; pE; pE = pE->m_pNext) pActor(pE);
+	}
 }
 
 raaLinkedListElement* popHead(raaLinkedList* pList)
@@ -111,6 +289,8 @@ raaLinkedListElement* popHead(raaLinkedList* pList)
 			pList->m_pHead->m_pLast = 0;
 			pE->m_pNext = 0;
 		}
+		pList->m_uiCount--;
+		if (pList->m_bChunked) chunkErase(pList, chunkHead(pList), 0);
 	}
 	return pE;
 }
@@ -128,6 +308,8 @@ raaLinkedListElement* popTail(raaLinkedList* pList)
 			pList->m_pTail->m_pNext = 0;
 			pE->m_pLast = 0;
 		}
+		pList->m_uiCount--;
+		if (pList->m_bChunked) chunkErase(pList, chunkTail(pList), chunkTail(pList)->m_uiCount - 1);
 	}
 	return pE;
 }
@@ -143,6 +325,11 @@ bool insertBefore(raaLinkedList* pList, raaLinkedListElement *pCurrentElement, r
 			pNewElement->m_pNext = pCurrentElement;
 			pNewElement->m_pLast->m_pNext = pNewElement;
 			pCurrentElement->m_pLast = pNewElement;
+			pList->m_uiCount++;
+
+			raaLinkedListChunk *pChunk;
+			unsigned int uiPos;
+			if (pList->m_bChunked && chunkFind(pCurrentElement, pChunk, uiPos)) chunkInsert(pList, pChunk, uiPos, pNewElement);
 		}
 		return true;
 	}
@@ -160,6 +347,11 @@ bool insertAfter(raaLinkedList* pList, raaLinkedListElement *pCurrentElement, ra
 			pNewElement->m_pLast = pCurrentElement;
 			pNewElement->m_pNext->m_pLast = pNewElement;
 			pCurrentElement->m_pNext = pNewElement;
+			pList->m_uiCount++;
+
+			raaLinkedListChunk *pChunk;
+			unsigned int uiPos;
+			if (pList->m_bChunked && chunkFind(pCurrentElement, pChunk, uiPos)) chunkInsert(pList, pChunk, uiPos + 1, pNewElement);
 		}
 		return true;
 	}
@@ -177,6 +369,11 @@ bool remove(raaLinkedList* pList, raaLinkedListElement* pElement)
 		pElement->m_pLast->m_pNext = pElement->m_pNext;
 		pElement->m_pNext = 0;
 		pElement->m_pLast = 0;
+		pList->m_uiCount--;
+
+		raaLinkedListChunk *pChunk;
+		unsigned int uiPos;
+		if (pList->m_bChunked && chunkFind(pElement, pChunk, uiPos)) chunkErase(pList, pChunk, uiPos);
 		return true;
 	}
 	return false;
@@ -184,7 +381,24 @@ bool remove(raaLinkedList* pList, raaLinkedListElement* pElement)
 
 bool isMember(raaLinkedList* pList, raaLinkedListElement* pElement)
 {
-	if (pList && pElement) for (raaLinkedListElement *pE = pList->m_pHead; pE; pE = pE->m_pNext) if (pE == pElement) return true;
+	if (pList && pElement)
+	{
+		raaLinkedListChunk *pChunk;
+		unsigned int uiPos;
+		if (pList->m_bChunked) return chunkFind(pElement, pChunk, uiPos) && chunkDirIndex(pList, pChunk) < pList->m_uiChunks;
+		for (raaLinkedListElement *pE = pList->m_pHead; pE; pE = pE->m_pNext) if (pE == pElement) return true;
+	}
 	return false;
 }
 
+void packList(raaLinkedList* pList)
+{
+	if (pList && pList->m_bChunked && !pList->m_bPacked)
+	{
+		while (pList->m_uiChunks) chunkRemoveDir(pList, pList->m_uiChunks - 1);
+		pList->m_bPacked = true;
+
+		for (raaLinkedListElement *pE = pList->m_pHead; pE; pE = pE->m_pNext) chunkInsert(pList, chunkTail(pList), pList->m_uiChunks ? chunkTail(pList)->m_uiCount : 0, pE);
+	}
+}
+
@@ -5,26 +5,47 @@
 #else
 #pragma comment(lib,"raaLinkedListR")
 #endif
+// chunked lists keep, alongside the element chain, the element pointers in order in chunks of two cache lines, allocated
+// on a cache line boundary
+const static unsigned int csg_uiListChunkAlignment = 64;
+const static unsigned int csg_uiListChunkSize = (2 * csg_uiListChunkAlignment - sizeof(unsigned int)) / sizeof(void*);
+
+struct _raaLinkedListChunk;
+
 typedef struct _raaLinkedListElement
 {
 	_raaLinkedListElement *m_pNext;
 	_raaLinkedListElement *m_pLast;
 	void *m_pData;
 	unsigned int m_uiType;
+	_raaLinkedListChunk *m_pChunk; // chunk holding this element when in a chunked list
 } raaLinkedListElement;
 
+typedef struct alignas(csg_uiListChunkAlignment) _raaLinkedListChunk
+{
+	_raaLinkedListElement *m_apElement[csg_uiListChunkSize];
+	unsigned int m_uiCount;
+} raaLinkedListChunk;
+
 typedef struct _raaLinkedList
 {
 	raaLinkedListElement *m_pHead;
 	raaLinkedListElement *m_pTail;
 	unsigned int m_uiType;
+	unsigned int m_uiCount;
+	bool m_bChunked;
+	bool m_bPacked; // every chunk but the last is full so item() can index directly
+	raaLinkedListChunk **m_apChunk;
+	unsigned int m_uiChunks;
+	unsigned int m_uiChunkCapacity;
 } raaLinkedList;
 
 typedef void (raaListDeletor)(raaLinkedListElement *pElement);
 typedef void (raaListActor)(raaLinkedListElement *pElement);
 
-void initList(raaLinkedList *pList, unsigned int uiType=0);
+void initList(raaLinkedList *pList, unsigned int uiType=0, bool bChunked=false);
 void destroyList(raaLinkedList *pList, raaListDeletor *pDeletor=0);
+void clearList(raaLinkedList *pList); // drops the list structure without touching the elements, for lists whose elements are owned elsewhere
 
 raaLinkedListElement* initElement(raaLinkedListElement *pElement, void* pData = 0, unsigned int uiType = 0);
 raaLinkedListElement* destroyElement(raaLinkedListElement *pElement, raaListDeletor *pDeletor=0);
@@ -42,4 +63,5 @@ bool insertBefore(raaLinkedList *pList, raaLinkedListElement *pCurrentElement, r
 bool insertAfter(raaLinkedList *pList, raaLinkedListElement *pCurrentElement, raaLinkedListElement *pNewElement);
 bool remove(raaLinkedList *pList, raaLinkedListElement *pElement);
 bool isMember(raaLinkedList *pList, raaLinkedListElement *pElement);
+void packList(raaLinkedList *pList); // re-fills the chunks of a chunked list after middle inserts/removes so item() is O(1) again
 
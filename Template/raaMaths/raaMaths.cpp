@@ -1,4 +1,4 @@
-#include "StdAfx.h"
+#include "stdafx.h"
 #include <stdlib.h>
 #include <time.h>
 #include <math.h>
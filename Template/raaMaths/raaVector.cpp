@@ -1,4 +1,4 @@
-#include "StdAfx.h"
+#include "stdafx.h"
 #include <math.h>
 #include "raaMaths.h"
 #include "raaVector.h"
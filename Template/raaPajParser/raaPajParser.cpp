@@ -3,6 +3,28 @@
 #include "raaPajParser.h"
 #include <string.h>
 
+#ifndef _MSC_VER
+#include <stdarg.h>
+
+// the secure crt calls used below, mapped onto their posix equivalents for gcc/clang builds
+template<size_t N> static int sprintf_s(char (&acBuffer)[N], const char *acFormat, ...)
+{
+	va_list args;
+	va_start(args, acFormat);
+	int iCount = vsnprintf(acBuffer, N, acFormat, args);
+	va_end(args);
+	return iCount;
+}
+
+static int fopen_s(FILE **ppFile, const char *acFile, const char *acMode)
+{
+	*ppFile = fopen(acFile, acMode);
+	return *ppFile ? 0 : 1;
+}
+
+#define strtok_s strtok_r
+#endif
+
 const static unsigned int csg_uiParseNetwork = 1;
 const static unsigned int csg_uiParseArcs = 2;
 const static unsigned int csg_uiEdges = 3;
@@ -22,13 +44,13 @@ void parse(const char* acFile, parseSectionFunction *pSectionFunction, parseNetw
 
 			while(!feof(pFile))
 			{
-				char acLine[64];
+				char acLine[256];
 				char *pcN = 0;
 				fpos_t pos;
 
 
 				fgetpos(pFile, &pos);
-				fgets(acLine, 64, pFile);
+				fgets(acLine, sizeof(acLine), pFile);
 
 				if (strlen(acLine)>1)
 				{
@@ -57,7 +79,7 @@ void parse(const char* acFile, parseSectionFunction *pSectionFunction, parseNetw
 						while (1)
 						{
 							fgetpos(pFile, &pos);
-							fgets(acLine, 64, pFile);
+							fgets(acLine, sizeof(acLine), pFile);
 							if(strlen(acLine))
 							{
 								if (strchr(acLine, '*'))
@@ -87,10 +109,10 @@ void parse(const char* acFile, parseSectionFunction *pSectionFunction, parseNetw
 							{
 								case csg_uiParseNetwork:
 								{
-									char acId[5];
-									char acName[32];
-									char acY[8];
-									char acZ[8];
+									char acId[16];
+									char acName[128];
+									char acY[32];
+									char acZ[32];
 									char *acNext = 0;
 									acId[0] = acName[0] = acY[0] = acZ[0] = '\0';
 
@@ -106,9 +128,9 @@ void parse(const char* acFile, parseSectionFunction *pSectionFunction, parseNetw
 								break;
 								case csg_uiParseArcs:
 								{
-									char acId0[5];
-									char acId1[5];
-									char acStrength[8];
+									char acId0[16];
+									char acId1[16];
+									char acStrength[32];
 									char *acNext = 0;
 									acId0[0] = acId1[0] = acStrength[0] = '\0';
 
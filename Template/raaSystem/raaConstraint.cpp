@@ -0,0 +1,132 @@
+#include "stdafx.h"
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "raaConstraint.h"
+
+void constraintInit(raaConstraints *pConstraints)
+{
+	if (pConstraints) memset(pConstraints, 0, sizeof(raaConstraints));
+}
+
+void constraintDestroy(raaConstraints *pConstraints)
+{
+	if (pConstraints)
+	{
+		delete[] pConstraints->m_auiColourStart;
+		delete[] pConstraints->m_auiArc;
+		delete[] pConstraints->m_afLambda;
+		memset(pConstraints, 0, sizeof(raaConstraints));
+	}
+}
+
+void constraintColour(raaConstraints *pConstraints, const raaTopology *pTopology)
+{
+	if (!pConstraints || !pTopology) return;
+
+	unsigned int uiArcs = pTopology->m_uiArcCount;
+	if (uiArcs > pConstraints->m_uiArcCapacity)
+	{
+		delete[] pConstraints->m_auiArc;
+		delete[] pConstraints->m_afLambda;
+		pConstraints->m_uiArcCapacity = uiArcs + uiArcs / 2;
+		pConstraints->m_auiArc = new unsigned int[pConstraints->m_uiArcCapacity];
+		pConstraints->m_afLambda = new float[pConstraints->m_uiArcCapacity];
+	}
+
+	// each arc takes the lowest colour not already taken by an earlier arc at either end, marked by stamping the arc index
+	std::vector<unsigned int> vColour(uiArcs), vStamp;
+	unsigned int uiColours = 0;
+
+	for (unsigned int a = 0; a < uiArcs; a++)
+	{
+		unsigned int auiNode[2] = { pTopology->m_auiArcNode0[a], pTopology->m_auiArcNode1[a] };
+
+		for (int k = 0; k < 2; k++) for (unsigned int j = pTopology->m_auiOffset[auiNode[k]]; j < pTopology->m_auiOffset[auiNode[k] + 1]; j++)
+		{
+			unsigned int b = pTopology->m_auiNeighbourArc[j];
+			if (b < a) vStamp[vColour[b]] = a + 1;
+		}
+
+		unsigned int c = 0;
+		while (c < uiColours && vStamp[c] == a + 1) c++;
+		if (c == uiColours)
+		{
+			uiColours++;
+			vStamp.push_back(0);
+		}
+		vColour[a] = c;
+	}
+
+	if (uiColours + 1 > pConstraints->m_uiColourCapacity)
+	{
+		delete[] pConstraints->m_auiColourStart;
+		pConstraints->m_uiColourCapacity = uiColours + 1;
+		pConstraints->m_auiColourStart = new unsigned int[pConstraints->m_uiColourCapacity];
+	}
+
+	// counting sort by colour, arc order is kept within a colour
+	memset(pConstraints->m_auiColourStart, 0, sizeof(unsigned int) * (uiColours + 1));
+	for (unsigned int a = 0; a < uiArcs; a++) pConstraints->m_auiColourStart[vColour[a] + 1]++;
+	for (unsigned int c = 0; c < uiColours; c++) pConstraints->m_auiColourStart[c + 1] += pConstraints->m_auiColourStart[c];
+
+	std::vector<unsigned int> vCursor(pConstraints->m_auiColourStart, pConstraints->m_auiColourStart + uiColours);
+	for (unsigned int a = 0; a < uiArcs; a++) pConstraints->m_auiArc[vCursor[vColour[a]]++] = a;
+
+	pConstraints->m_uiColours = uiColours;
+	pConstraints->m_uiArcCount = uiArcs;
+}
+
+void constraintBegin(raaConstraints *pConstraints)
+{
+	if (pConstraints && pConstraints->m_uiArcCount) memset(pConstraints->m_afLambda, 0, sizeof(float) * pConstraints->m_uiArcCount);
+}
+
+void constraintProject(raaConstraints *pConstraints, const raaTopology *pTopology, float *afPosition, const float *afInvMass, float fTimeStep, raaThreadPool *pPool)
+{
+	if (!pConstraints || !pTopology || !pConstraints->m_uiArcCount) return;
+
+	float fInvStep2 = 1.0f / (fTimeStep * fTimeStep);
+	float *afLambda = pConstraints->m_afLambda;
+	const unsigned int *auiArc = pConstraints->m_auiArc;
+
+	auto fProject = [pTopology, afPosition, afInvMass, fInvStep2, afLambda, auiArc](unsigned int uiBegin, unsigned int uiEnd, unsigned int)
+	{
+		for (unsigned int k = uiBegin; k < uiEnd; k++)
+		{
+			unsigned int uiArc = auiArc[k];
+			unsigned int uiNode0 = pTopology->m_auiArcNode0[uiArc], uiNode1 = pTopology->m_auiArcNode1[uiArc];
+			float fInvMass0 = afInvMass[uiNode0], fInvMass1 = afInvMass[uiNode1];
+			float fCoef = pTopology->m_afArcSpringCoef[uiArc];
+
+			if (uiNode0 == uiNode1 || fInvMass0 + fInvMass1 <= 0.0f || fCoef <= 0.0f) continue;
+
+			float *pfPosition0 = afPosition + uiNode0 * 4, *pfPosition1 = afPosition + uiNode1 * 4;
+			float afDelta[3];
+			for (int i = 0; i < 3; i++) afDelta[i] = pfPosition1[i] - pfPosition0[i];
+			float fDistance = sqrtf(afDelta[0] * afDelta[0] + afDelta[1] * afDelta[1] + afDelta[2] * afDelta[2]);
+			if (fDistance <= 0.0f) continue;
+
+			// xpbd, dlambda = -(C + alpha lambda) / (w0 + w1 + alpha) with alpha = compliance / dt^2
+			float fAlpha = fInvStep2 / fCoef;
+			float fLambda = -(fDistance - pTopology->m_afArcIdealLen[uiArc] + fAlpha * afLambda[uiArc]) / (fInvMass0 + fInvMass1 + fAlpha);
+			afLambda[uiArc] += fLambda;
+
+			float fScale = fLambda / fDistance;
+			for (int i = 0; i < 3; i++)
+			{
+				pfPosition0[i] -= fInvMass0 * fScale * afDelta[i];
+				pfPosition1[i] += fInvMass1 * fScale * afDelta[i];
+			}
+		}
+	};
+
+	for (unsigned int c = 0; c < pConstraints->m_uiColours; c++)
+	{
+		unsigned int uiBegin = pConstraints->m_auiColourStart[c], uiEnd = pConstraints->m_auiColourStart[c + 1];
+
+		// the many small colours of the high degree nodes are not worth waking the pool for
+		if (pPool && uiEnd - uiBegin > csg_uiConstraintChunk) threadPoolFor(pPool, uiEnd - uiBegin, csg_uiConstraintChunk, [&fProject, uiBegin](unsigned int uiFirst, unsigned int uiLast, unsigned int uiThread) { fProject(uiBegin + uiFirst, uiBegin + uiLast, uiThread); });
+		else fProject(uiBegin, uiEnd, 0);
+	}
+}
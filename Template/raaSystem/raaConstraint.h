@@ -0,0 +1,40 @@
+#pragma once
+#ifdef _DEBUG
+#pragma comment(lib,"raaSystemD")
+#else
+#pragma comment(lib,"raaSystemR")
+#endif
+
+#include "raaSystem.h"
+#include "raaThreadPool.h"
+
+// arcs as distance constraints for the position based solver mode, holding the ends m_afArcIdealLen apart with compliance
+// 1 / m_afArcSpringCoef (xpbd). The arcs are edge coloured and a sweep projects one colour at a time, its arcs in parallel,
+// so no two threads move the same node.
+
+const static unsigned int csg_uiConstraintChunk = 1024;
+const static unsigned int csg_uiConstraintDefaultIterations = 8;
+
+typedef struct _raaConstraints
+{
+	unsigned int m_uiArcCount; // arcs the colouring was built for
+	unsigned int m_uiColours;
+	unsigned int *m_auiColourStart; // m_uiColours + 1, colour c is m_auiArc[m_auiColourStart[c], m_auiColourStart[c + 1])
+	unsigned int *m_auiArc; // arcs by colour, ascending within a colour
+	float *m_afLambda; // per arc accumulated constraint force over the step
+	unsigned int m_uiArcCapacity;
+	unsigned int m_uiColourCapacity;
+} raaConstraints;
+
+void constraintInit(raaConstraints *pConstraints);
+void constraintDestroy(raaConstraints *pConstraints);
+
+// greedy edge colouring of the topology arcs in arc order, needs the adjacency (updateAdjacency). At most 2 * max degree - 1
+// colours
+void constraintColour(raaConstraints *pConstraints, const raaTopology *pTopology);
+
+// clears the accumulated lambdas, once per step before the sweeps
+void constraintBegin(raaConstraints *pConstraints);
+
+// one sweep over every arc, moving afPosition. fTimeStep scales the compliance
+void constraintProject(raaConstraints *pConstraints, const raaTopology *pTopology, float *afPosition, const float *afInvMass, float fTimeStep, raaThreadPool *pPool=0);
@@ -0,0 +1,428 @@
+#include "stdafx.h"
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "raaFMM.h"
+
+// with d = node - centre and the multi-index notation d^n = dx^a dy^b dz^c, n! = a! b! c!:
+//   multipole  M_n = sum d^n / n!
+//   potential  phi(x) = sum_n (-1)^|n| M_n D^n(1/r)(x - c)
+//   local      L_m = sum_n (-1)^|n| M_n D^(n+m)(1/r)(t - c), phi(t + e) = sum_m L_m e^m / m!
+//   force      F_i = -d phi / d e_i = -sum_m L_(m+e_i) e^m / m!
+// shifting a multipole or local by s multiplies by s^k / k!, these are the m_aShift pairs (target n, source k, operator n-k)
+
+static const double csg_dSqrt3 = 1.7320508075688772;
+
+static void fmmPowers(const double *adD, unsigned int uiOrder, double (*adPower)[csg_uiFMMMaxOrder + 1])
+{
+	for (int i = 0; i < 3; i++)
+	{
+		adPower[i][0] = 1.0;
+		for (unsigned int k = 1; k <= uiOrder; k++) adPower[i][k] = adPower[i][k - 1] * adD[i];
+	}
+}
+
+// d^n / n! for every term
+static void fmmMonomials(const raaFMM *pFMM, const double *adD, double *adOut)
+{
+	double adPower[3][csg_uiFMMMaxOrder + 1];
+	fmmPowers(adD, pFMM->m_uiOrder, adPower);
+	for (unsigned int t = 0; t < pFMM->m_uiTerms; t++)
+	{
+		const unsigned char *pucE = pFMM->m_aucExponent + t * 3;
+		adOut[t] = adPower[0][pucE[0]] * adPower[1][pucE[1]] * adPower[2][pucE[2]] * pFMM->m_adInvFactorial[t];
+	}
+}
+
+// D^n (1/r) for every term by the recurrence |n| r^2 T_n = -sum_i [(2|n|-1) n_i r_i T_(n-e_i) + (|n|-1) n_i (n_i-1) T_(n-2e_i)]
+static void fmmDerivatives(const raaFMM *pFMM, const double *adR, double *adOut)
+{
+	double dR2 = adR[0] * adR[0] + adR[1] * adR[1] + adR[2] * adR[2];
+	double dInvR2 = 1.0 / dR2;
+
+	adOut[0] = sqrt(dInvR2);
+	for (unsigned int t = 1; t < pFMM->m_uiTerms; t++)
+	{
+		const unsigned char *pucE = pFMM->m_aucExponent + t * 3;
+		const unsigned int *puiLower = pFMM->m_auiLower + t * 6;
+		double dDegree = pucE[0] + pucE[1] + pucE[2];
+		double dSum = 0.0;
+
+		for (int i = 0; i < 3; i++)
+		{
+			if (pucE[i])
+			{
+				dSum += (2.0 * dDegree - 1.0) * pucE[i] * adR[i] * adOut[puiLower[i]];
+				if (pucE[i] > 1) dSum += (dDegree - 1.0) * pucE[i] * (pucE[i] - 1) * adOut[puiLower[3 + i]];
+			}
+		}
+		adOut[t] = -dSum * dInvR2 / dDegree;
+	}
+}
+
+static void fmmShift(const raaFMM *pFMM, const double *adSource, double *adTarget, const double *adS, bool bUp)
+{
+	for (unsigned int p = 0; p < pFMM->m_uiShifts; p++)
+	{
+		const raaFMMPair *pPair = pFMM->m_aShift + p;
+		if (bUp) adTarget[pPair->m_usTarget] += adSource[pPair->m_usSource] * adS[pPair->m_usOperator]; // m2m
+		else adTarget[pPair->m_usSource] += adSource[pPair->m_usTarget] * adS[pPair->m_usOperator]; // l2l
+	}
+}
+
+static void fmmUpward(raaFMM *pFMM, const raaOctree *pTree, const float *afPosition, unsigned int uiCell)
+{
+	const raaOctreeCell *pCell = pTree->m_aCell + uiCell;
+	double *adM = pFMM->m_adMultipole + uiCell * pFMM->m_uiTerms;
+	double adS[256];
+
+	memset(adM, 0, sizeof(double)*pFMM->m_uiTerms);
+
+	if (!pCell->m_uiChild)
+	{
+		for (unsigned int n = pCell->m_uiBegin; n < pCell->m_uiEnd; n++)
+		{
+			const float *pfP = afPosition + pTree->m_auiOrder[n] * 4;
+			double adD[3] = { (double)pfP[0] - pCell->m_afCentre[0], (double)pfP[1] - pCell->m_afCentre[1], (double)pfP[2] - pCell->m_afCentre[2] };
+			fmmMonomials(pFMM, adD, adS);
+			for (unsigned int t = 0; t < pFMM->m_uiTerms; t++) adM[t] += adS[t];
+		}
+	}
+	else
+	{
+		for (unsigned int k = 0; k < pCell->m_uiChildCount; k++)
+		{
+			unsigned int uiChild = pCell->m_uiChild + k;
+			const raaOctreeCell *pChild = pTree->m_aCell + uiChild;
+			double adD[3] = { (double)pChild->m_afCentre[0] - pCell->m_afCentre[0], (double)pChild->m_afCentre[1] - pCell->m_afCentre[1], (double)pChild->m_afCentre[2] - pCell->m_afCentre[2] };
+
+			fmmUpward(pFMM, pTree, afPosition, uiChild);
+			fmmMonomials(pFMM, adD, adS);
+			fmmShift(pFMM, pFMM->m_adMultipole + uiChild * pFMM->m_uiTerms, adM, adS, true);
+		}
+	}
+}
+
+static void fmmUpwardCell(raaFMM *pFMM, const raaOctree *pTree, unsigned int uiCell)
+{
+	const raaOctreeCell *pCell = pTree->m_aCell + uiCell;
+	double *adM = pFMM->m_adMultipole + uiCell * pFMM->m_uiTerms;
+	double adS[256];
+
+	memset(adM, 0, sizeof(double)*pFMM->m_uiTerms);
+	for (unsigned int k = 0; k < pCell->m_uiChildCount; k++)
+	{
+		const raaOctreeCell *pChild = pTree->m_aCell + pCell->m_uiChild + k;
+		double adD[3] = { (double)pChild->m_afCentre[0] - pCell->m_afCentre[0], (double)pChild->m_afCentre[1] - pCell->m_afCentre[1], (double)pChild->m_afCentre[2] - pCell->m_afCentre[2] };
+		fmmMonomials(pFMM, adD, adS);
+		fmmShift(pFMM, pFMM->m_adMultipole + (pCell->m_uiChild + k) * pFMM->m_uiTerms, adM, adS, true);
+	}
+}
+
+static void fmmM2L(raaFMM *pFMM, const raaOctree *pTree, unsigned int uiTarget, unsigned int uiSource)
+{
+	const raaOctreeCell *pT = pTree->m_aCell + uiTarget;
+	const raaOctreeCell *pS = pTree->m_aCell + uiSource;
+	const double *adM = pFMM->m_adMultipole + uiSource * pFMM->m_uiTerms;
+	double *adL = pFMM->m_adLocal + uiTarget * pFMM->m_uiTerms;
+	double adR[3] = { (double)pT->m_afCentre[0] - pS->m_afCentre[0], (double)pT->m_afCentre[1] - pS->m_afCentre[1], (double)pT->m_afCentre[2] - pS->m_afCentre[2] };
+	double adD[256];
+
+	fmmDerivatives(pFMM, adR, adD);
+	for (unsigned int p = 0; p < pFMM->m_uiM2Ls; p++)
+	{
+		const raaFMMPair *pPair = pFMM->m_aM2L + p;
+		adL[pPair->m_usTarget] += pPair->m_sSign * adM[pPair->m_usSource] * adD[pPair->m_usOperator];
+	}
+}
+
+static void fmmP2P(const raaOctree *pTree, const float *afPosition, float *afForce, unsigned int uiTarget, unsigned int uiSource, float fCharge, float fSoftening2)
+{
+	const raaOctreeCell *pT = pTree->m_aCell + uiTarget;
+	const raaOctreeCell *pS = pTree->m_aCell + uiSource;
+
+	for (unsigned int n = pT->m_uiBegin; n < pT->m_uiEnd; n++)
+	{
+		unsigned int uiNode = pTree->m_auiOrder[n];
+		const float *pfP = afPosition + uiNode * 4;
+		float afF[3] = { 0.0f, 0.0f, 0.0f };
+
+		for (unsigned int m = pS->m_uiBegin; m < pS->m_uiEnd; m++)
+		{
+			unsigned int uiOther = pTree->m_auiOrder[m];
+			if (uiOther != uiNode)
+			{
+				const float *pfQ = afPosition + uiOther * 4;
+				float afE[3] = { pfP[0] - pfQ[0], pfP[1] - pfQ[1], pfP[2] - pfQ[2] };
+				float fE2 = afE[0] * afE[0] + afE[1] * afE[1] + afE[2] * afE[2] + fSoftening2;
+				float fScale = 1.0f / (fE2 * sqrtf(fE2));
+				for (int i = 0; i < 3; i++) afF[i] += afE[i] * fScale;
+			}
+		}
+		for (int i = 0; i < 3; i++) afForce[uiNode * 4 + i] += afF[i] * fCharge;
+	}
+}
+
+static void fmmDownward(raaFMM *pFMM, const raaOctree *pTree, const float *afPosition, float *afForce, unsigned int uiCell, float fCharge)
+{
+	const raaOctreeCell *pCell = pTree->m_aCell + uiCell;
+	const double *adL = pFMM->m_adLocal + uiCell * pFMM->m_uiTerms;
+	double adS[256];
+
+	if (!pCell->m_uiChild)
+	{
+		for (unsigned int n = pCell->m_uiBegin; n < pCell->m_uiEnd; n++)
+		{
+			unsigned int uiNode = pTree->m_auiOrder[n];
+			const float *pfP = afPosition + uiNode * 4;
+			double adE[3] = { (double)pfP[0] - pCell->m_afCentre[0], (double)pfP[1] - pCell->m_afCentre[1], (double)pfP[2] - pCell->m_afCentre[2] };
+			double adF[3] = { 0.0, 0.0, 0.0 };
+
+			fmmMonomials(pFMM, adE, adS);
+			for (unsigned int t = 0; t < pFMM->m_uiTerms; t++)
+				for (int i = 0; i < 3; i++) if (pFMM->m_auiGradient[t * 3 + i] != csg_uiFMMNone) adF[i] -= adL[pFMM->m_auiGradient[t * 3 + i]] * adS[t];
+
+			for (int i = 0; i < 3; i++) afForce[uiNode * 4 + i] += (float)adF[i] * fCharge;
+		}
+	}
+	else
+	{
+		for (unsigned int k = 0; k < pCell->m_uiChildCount; k++)
+		{
+			unsigned int uiChild = pCell->m_uiChild + k;
+			const raaOctreeCell *pChild = pTree->m_aCell + uiChild;
+			double adD[3] = { (double)pChild->m_afCentre[0] - pCell->m_afCentre[0], (double)pChild->m_afCentre[1] - pCell->m_afCentre[1], (double)pChild->m_afCentre[2] - pCell->m_afCentre[2] };
+
+			fmmMonomials(pFMM, adD, adS);
+			fmmShift(pFMM, adL, pFMM->m_adLocal + uiChild * pFMM->m_uiTerms, adS, false);
+			fmmDownward(pFMM, pTree, afPosition, afForce, uiChild, fCharge);
+		}
+	}
+}
+
+// everything the source tree does to the target subtree, expansions go into the locals of the target subtree and direct
+// sums into the forces of its nodes
+static void fmmInteract(raaFMM *pFMM, const raaOctree *pTree, const float *afPosition, float *afForce, unsigned int uiTarget, float fCharge, float fSoftening2, float fTheta)
+{
+	std::vector<unsigned int> vStack;
+	vStack.push_back(uiTarget);
+	vStack.push_back(0);
+
+	while (!vStack.empty())
+	{
+		unsigned int uiS = vStack.back(); vStack.pop_back();
+		unsigned int uiT = vStack.back(); vStack.pop_back();
+		const raaOctreeCell *pT = pTree->m_aCell + uiT;
+		const raaOctreeCell *pS = pTree->m_aCell + uiS;
+
+		float afR[3] = { pT->m_afCentre[0] - pS->m_afCentre[0], pT->m_afCentre[1] - pS->m_afCentre[1], pT->m_afCentre[2] - pS->m_afCentre[2] };
+		float fRadius = (pT->m_afCentre[3] + pS->m_afCentre[3]) * (float)csg_dSqrt3;
+		float fR2 = afR[0] * afR[0] + afR[1] * afR[1] + afR[2] * afR[2];
+
+		if (fRadius * fRadius < fTheta * fTheta * fR2) fmmM2L(pFMM, pTree, uiT, uiS);
+		else if (!pT->m_uiChild && !pS->m_uiChild) fmmP2P(pTree, afPosition, afForce, uiT, uiS, fCharge, fSoftening2);
+		else if (!pS->m_uiChild || (pT->m_uiChild && pT->m_afCentre[3] >= pS->m_afCentre[3]))
+		{
+			for (unsigned int k = 0; k < pT->m_uiChildCount; k++) { vStack.push_back(pT->m_uiChild + k); vStack.push_back(uiS); }
+		}
+		else
+		{
+			for (unsigned int k = 0; k < pS->m_uiChildCount; k++) { vStack.push_back(uiT); vStack.push_back(pS->m_uiChild + k); }
+		}
+	}
+}
+
+void fmmInit(raaFMM* pFMM, unsigned int uiOrder)
+{
+	if (pFMM)
+	{
+		memset(pFMM, 0, sizeof(raaFMM));
+		fmmSetOrder(pFMM, uiOrder);
+	}
+}
+
+void fmmDestroy(raaFMM* pFMM)
+{
+	if (pFMM)
+	{
+		delete[] pFMM->m_aucExponent;
+		delete[] pFMM->m_adInvFactorial;
+		delete[] pFMM->m_auiGradient;
+		delete[] pFMM->m_auiLower;
+		delete[] pFMM->m_aShift;
+		delete[] pFMM->m_aM2L;
+		delete[] pFMM->m_adMultipole;
+		delete[] pFMM->m_adLocal;
+		delete[] pFMM->m_auiFrontier;
+		delete[] pFMM->m_auiUpper;
+		memset(pFMM, 0, sizeof(raaFMM));
+	}
+}
+
+void fmmSetOrder(raaFMM* pFMM, unsigned int uiOrder)
+{
+	if (!pFMM) return;
+
+	if (uiOrder < 1) uiOrder = 1;
+	if (uiOrder > csg_uiFMMMaxOrder) uiOrder = csg_uiFMMMaxOrder;
+	if (uiOrder == pFMM->m_uiOrder && pFMM->m_aucExponent) return;
+
+	delete[] pFMM->m_aucExponent;
+	delete[] pFMM->m_adInvFactorial;
+	delete[] pFMM->m_auiGradient;
+	delete[] pFMM->m_auiLower;
+	delete[] pFMM->m_aShift;
+	delete[] pFMM->m_aM2L;
+	delete[] pFMM->m_adMultipole;
+	delete[] pFMM->m_adLocal;
+	pFMM->m_adMultipole = pFMM->m_adLocal = 0;
+	pFMM->m_uiCellCapacity = 0;
+
+	// terms sorted by degree, so the terms of degree <= k are always a prefix
+	unsigned int uiTerms = (uiOrder + 1) * (uiOrder + 2) * (uiOrder + 3) / 6;
+	unsigned int uiSide = uiOrder + 1;
+	std::vector<unsigned int> vIndex(uiSide * uiSide * uiSide, csg_uiFMMNone);
+
+	pFMM->m_uiOrder = uiOrder;
+	pFMM->m_uiTerms = uiTerms;
+	pFMM->m_aucExponent = new unsigned char[uiTerms * 3];
+	pFMM->m_adInvFactorial = new double[uiTerms];
+	pFMM->m_auiGradient = new unsigned int[uiTerms * 3];
+	pFMM->m_auiLower = new unsigned int[uiTerms * 6];
+
+	double adFactorial[csg_uiFMMMaxOrder + 1];
+	adFactorial[0] = 1.0;
+	for (unsigned int k = 1; k <= csg_uiFMMMaxOrder; k++) adFactorial[k] = adFactorial[k - 1] * k;
+
+	unsigned int t = 0;
+	for (unsigned int uiDegree = 0; uiDegree <= uiOrder; uiDegree++)
+	{
+		for (int a = uiDegree; a >= 0; a--)
+		{
+			for (int b = uiDegree - a; b >= 0; b--)
+			{
+				int c = uiDegree - a - b;
+				pFMM->m_aucExponent[t * 3] = (unsigned char)a;
+				pFMM->m_aucExponent[t * 3 + 1] = (unsigned char)b;
+				pFMM->m_aucExponent[t * 3 + 2] = (unsigned char)c;
+				pFMM->m_adInvFactorial[t] = 1.0 / (adFactorial[a] * adFactorial[b] * adFactorial[c]);
+				vIndex[(a * uiSide + b) * uiSide + c] = t;
+				t++;
+			}
+		}
+	}
+
+	std::vector<raaFMMPair> vShift, vM2L;
+	for (t = 0; t < uiTerms; t++)
+	{
+		const unsigned char *pucE = pFMM->m_aucExponent + t * 3;
+		unsigned int uiDegree = pucE[0] + pucE[1] + pucE[2];
+
+		for (int i = 0; i < 3; i++)
+		{
+			int aiUp[3] = { pucE[0], pucE[1], pucE[2] };
+			aiUp[i]++;
+			pFMM->m_auiGradient[t * 3 + i] = uiDegree < uiOrder ? vIndex[(aiUp[0] * uiSide + aiUp[1]) * uiSide + aiUp[2]] : csg_uiFMMNone;
+
+			int aiDown[3] = { pucE[0], pucE[1], pucE[2] };
+			aiDown[i]--;
+			pFMM->m_auiLower[t * 6 + i] = aiDown[i] >= 0 ? vIndex[(aiDown[0] * uiSide + aiDown[1]) * uiSide + aiDown[2]] : csg_uiFMMNone;
+			aiDown[i]--;
+			pFMM->m_auiLower[t * 6 + 3 + i] = aiDown[i] >= 0 ? vIndex[(aiDown[0] * uiSide + aiDown[1]) * uiSide + aiDown[2]] : csg_uiFMMNone;
+		}
+
+		for (unsigned int u = 0; u < uiTerms; u++)
+		{
+			const unsigned char *pucF = pFMM->m_aucExponent + u * 3;
+			unsigned int uiDegreeU = pucF[0] + pucF[1] + pucF[2];
+
+			// shift pairs: u <= t componentwise
+			if (pucF[0] <= pucE[0] && pucF[1] <= pucE[1] && pucF[2] <= pucE[2])
+			{
+				raaFMMPair Pair = { (unsigned short)t, (unsigned short)u, (unsigned short)vIndex[((pucE[0] - pucF[0]) * uiSide + pucE[1] - pucF[1]) * uiSide + pucE[2] - pucF[2]], 1 };
+				vShift.push_back(Pair);
+			}
+
+			// m2l pairs: local t from multipole u through the derivative t+u
+			if (uiDegree + uiDegreeU <= uiOrder)
+			{
+				raaFMMPair Pair = { (unsigned short)t, (unsigned short)u, (unsigned short)vIndex[((pucE[0] + pucF[0]) * uiSide + pucE[1] + pucF[1]) * uiSide + pucE[2] + pucF[2]], (short)(uiDegreeU & 1 ? -1 : 1) };
+				vM2L.push_back(Pair);
+			}
+		}
+	}
+
+	pFMM->m_uiShifts = (unsigned int)vShift.size();
+	pFMM->m_aShift = new raaFMMPair[vShift.size()];
+	memcpy(pFMM->m_aShift, vShift.data(), sizeof(raaFMMPair)*vShift.size());
+	pFMM->m_uiM2Ls = (unsigned int)vM2L.size();
+	pFMM->m_aM2L = new raaFMMPair[vM2L.size()];
+	memcpy(pFMM->m_aM2L, vM2L.data(), sizeof(raaFMMPair)*vM2L.size());
+}
+
+void fmmRepulsion(raaFMM* pFMM, const raaOctree* pTree, const float* afPosition, float* afForce, float fCharge, float fSoftening, float fTheta, raaThreadPool* pPool)
+{
+	if (!pFMM || !pTree || !pTree->m_uiCells) return;
+
+	unsigned int uiCells = pTree->m_uiCells;
+	if (uiCells > pFMM->m_uiCellCapacity)
+	{
+		delete[] pFMM->m_adMultipole;
+		delete[] pFMM->m_adLocal;
+		pFMM->m_uiCellCapacity = uiCells + uiCells / 2;
+		pFMM->m_adMultipole = new double[pFMM->m_uiCellCapacity * pFMM->m_uiTerms];
+		pFMM->m_adLocal = new double[pFMM->m_uiCellCapacity * pFMM->m_uiTerms];
+	}
+	if (uiCells > pFMM->m_uiListCapacity)
+	{
+		delete[] pFMM->m_auiFrontier;
+		delete[] pFMM->m_auiUpper;
+		pFMM->m_uiListCapacity = uiCells + uiCells / 2;
+		pFMM->m_auiFrontier = new unsigned int[pFMM->m_uiListCapacity];
+		pFMM->m_auiUpper = new unsigned int[pFMM->m_uiListCapacity];
+	}
+
+	// split the tree into subtrees of about uiGrain nodes for the threads, the cells above them are done serially
+	unsigned int uiThreads = pPool ? threadPoolThreads(pPool) : 1;
+	unsigned int uiGrain = pFMM->m_uiGrain ? pFMM->m_uiGrain : uiThreads > 1 ? pTree->m_uiCount / (uiThreads * 16) : pTree->m_uiCount;
+	if (uiGrain < csg_uiFMMLeafSize) uiGrain = csg_uiFMMLeafSize;
+
+	pFMM->m_uiFrontier = pFMM->m_uiUpper = 0;
+	std::vector<unsigned int> vStack(1, 0);
+	while (!vStack.empty())
+	{
+		unsigned int uiCell = vStack.back(); vStack.pop_back();
+		const raaOctreeCell *pCell = pTree->m_aCell + uiCell;
+
+		if (!pCell->m_uiChild || pCell->m_uiEnd - pCell->m_uiBegin <= uiGrain) pFMM->m_auiFrontier[pFMM->m_uiFrontier++] = uiCell;
+		else
+		{
+			pFMM->m_auiUpper[pFMM->m_uiUpper++] = uiCell;
+			for (unsigned int k = 0; k < pCell->m_uiChildCount; k++) vStack.push_back(pCell->m_uiChild + k);
+		}
+	}
+
+	float fSoftening2 = fSoftening * fSoftening;
+	auto fUpward = [pFMM, pTree, afPosition](unsigned int uiBegin, unsigned int uiEnd, unsigned int)
+	{
+		for (unsigned int i = uiBegin; i < uiEnd; i++) fmmUpward(pFMM, pTree, afPosition, pFMM->m_auiFrontier[i]);
+	};
+	auto fDownward = [pFMM, pTree, afPosition, afForce, fCharge, fSoftening2, fTheta](unsigned int uiBegin, unsigned int uiEnd, unsigned int)
+	{
+		for (unsigned int i = uiBegin; i < uiEnd; i++)
+		{
+			fmmInteract(pFMM, pTree, afPosition, afForce, pFMM->m_auiFrontier[i], fCharge, fSoftening2, fTheta);
+			fmmDownward(pFMM, pTree, afPosition, afForce, pFMM->m_auiFrontier[i], fCharge);
+		}
+	};
+
+	// multipoles - subtrees in parallel, then the cells above them children first (reverse of the depth first order)
+	if (pPool) threadPoolFor(pPool, pFMM->m_uiFrontier, 1, fUpward);
+	else fUpward(0, pFMM->m_uiFrontier, 0);
+	for (unsigned int i = pFMM->m_uiUpper; i-- > 0;) fmmUpwardCell(pFMM, pTree, pFMM->m_auiUpper[i]);
+
+	// locals and forces - each subtree gathers from the whole tree so the subtrees are independent
+	memset(pFMM->m_adLocal, 0, sizeof(double)*uiCells*pFMM->m_uiTerms);
+	if (pPool) threadPoolFor(pPool, pFMM->m_uiFrontier, 1, fDownward);
+	else fDownward(0, pFMM->m_uiFrontier, 0);
+}
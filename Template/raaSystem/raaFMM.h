@@ -0,0 +1,64 @@
+#pragma once
+#ifdef _DEBUG
+#pragma comment(lib,"raaSystemD")
+#else
+#pragma comment(lib,"raaSystemR")
+#endif
+
+#include "raaOctree.h"
+#include "raaThreadPool.h"
+
+// fast multipole evaluation of the node repulsion over the solver octree, using cartesian taylor expansions of 1/r truncated
+// at a total order of m_uiOrder. Multipoles are built bottom up, a dual tree walk turns well separated cell pairs into
+// local expansions (m2l) and everything else into direct sums, and the locals are pushed down to the nodes. The error falls
+// roughly as theta^order, the cost is O(N) in the number of nodes for a fixed order. The defaults give a little less force
+// error than barnes-hut at csg_fSolverDefaultTheta for slightly more time, the fmm only pays off when more accuracy is wanted.
+
+const static unsigned int csg_uiFMMMaxOrder = 8;
+const static unsigned int csg_uiFMMDefaultOrder = 4;
+const static float csg_fFMMDefaultTheta = 0.9f; // cells interact through expansions when (r0 + r1) < theta * distance
+const static unsigned int csg_uiFMMLeafSize = 64;
+const static unsigned int csg_uiFMMNone = 0xffffffff;
+const static unsigned int csg_uiFMMFixedGrain = 2048; // subtree size for a fixed split, see m_uiGrain
+
+// one multi-index term pairing used by the translation operators, see raaFMM.cpp
+typedef struct _raaFMMPair
+{
+	unsigned short m_usTarget;
+	unsigned short m_usSource;
+	unsigned short m_usOperator;
+	short m_sSign;
+} raaFMMPair;
+
+typedef struct _raaFMM
+{
+	unsigned int m_uiOrder;
+	unsigned int m_uiTerms; // multi-indices n with |n| <= order, sorted by degree
+	unsigned char *m_aucExponent; // 3 per term
+	double *m_adInvFactorial; // 1/n! per term
+	unsigned int *m_auiGradient; // 3 per term, index of n+e_i or csg_uiFMMNone
+	unsigned int *m_auiLower; // 6 per term, index of n-e_i then n-2e_i or csg_uiFMMNone, for the derivative recurrence
+	raaFMMPair *m_aShift; // m2m and l2l
+	unsigned int m_uiShifts;
+	raaFMMPair *m_aM2L;
+	unsigned int m_uiM2Ls;
+
+	double *m_adMultipole; // m_uiTerms per octree cell
+	double *m_adLocal;
+	unsigned int m_uiCellCapacity;
+
+	unsigned int m_uiGrain; // 0 sizes the subtrees from the thread count, otherwise the split (and so the result) ignores it
+	unsigned int *m_auiFrontier; // subtrees handed to the threads
+	unsigned int m_uiFrontier;
+	unsigned int *m_auiUpper; // cells above the frontier
+	unsigned int m_uiUpper;
+	unsigned int m_uiListCapacity;
+} raaFMM;
+
+void fmmInit(raaFMM *pFMM, unsigned int uiOrder=csg_uiFMMDefaultOrder);
+void fmmDestroy(raaFMM *pFMM);
+void fmmSetOrder(raaFMM *pFMM, unsigned int uiOrder); // clamped to [1, csg_uiFMMMaxOrder]
+
+// adds fCharge * d / |d|^3 from every other node to afForce (4 floats per node), near pairs are softened as for barnes-hut.
+// Runs on pPool if given, each thread owns whole subtrees so no node force is written by two threads.
+void fmmRepulsion(raaFMM *pFMM, const raaOctree *pTree, const float *afPosition, float *afForce, float fCharge, float fSoftening, float fTheta, raaThreadPool *pPool=0);
@@ -0,0 +1,143 @@
+#include "stdafx.h"
+#include <math.h>
+#include <string.h>
+#include "raaGrid.h"
+
+const static unsigned int csg_uiGridChunk = 1024;
+
+void gridInit(raaGrid *pGrid)
+{
+	if (pGrid) memset(pGrid, 0, sizeof(raaGrid));
+}
+
+void gridDestroy(raaGrid *pGrid)
+{
+	if (pGrid)
+	{
+		delete[] pGrid->m_auiStart;
+		delete[] pGrid->m_auiCursor;
+		delete[] pGrid->m_auiOrder;
+		delete[] pGrid->m_auiBucket;
+		memset(pGrid, 0, sizeof(raaGrid));
+	}
+}
+
+template<class F> static void gridFor(raaThreadPool *pPool, unsigned int uiCount, F fFunction)
+{
+	if (pPool) threadPoolFor(pPool, uiCount, csg_uiGridChunk, fFunction);
+	else fFunction(0, uiCount, 0);
+}
+
+void gridBuild(raaGrid *pGrid, const float *afPosition, unsigned int uiCount, float fCellSize, raaThreadPool *pPool)
+{
+	if (!pGrid || !afPosition || fCellSize <= 0.0f) return;
+
+	unsigned int uiBuckets = csg_uiGridMinBuckets;
+	while (uiBuckets < uiCount * 2) uiBuckets <<= 1;
+
+	if (uiCount > pGrid->m_uiCapacity)
+	{
+		delete[] pGrid->m_auiOrder;
+		delete[] pGrid->m_auiBucket;
+		pGrid->m_uiCapacity = uiCount + uiCount / 2;
+		pGrid->m_auiOrder = new unsigned int[pGrid->m_uiCapacity];
+		pGrid->m_auiBucket = new unsigned int[pGrid->m_uiCapacity];
+	}
+	if (uiBuckets > pGrid->m_uiBucketCapacity)
+	{
+		delete[] pGrid->m_auiStart;
+		delete[] pGrid->m_auiCursor;
+		pGrid->m_uiBucketCapacity = uiBuckets;
+		pGrid->m_auiStart = new unsigned int[uiBuckets + 1];
+		pGrid->m_auiCursor = new std::atomic<unsigned int>[uiBuckets];
+	}
+
+	pGrid->m_fCellSize = fCellSize;
+	pGrid->m_fInvCellSize = 1.0f / fCellSize;
+	pGrid->m_uiCount = uiCount;
+	pGrid->m_uiBuckets = uiBuckets;
+
+	for (unsigned int b = 0; b < uiBuckets; b++) pGrid->m_auiCursor[b].store(0, std::memory_order_relaxed);
+
+	// count
+	gridFor(pPool, uiCount, [pGrid, afPosition](unsigned int uiBegin, unsigned int uiEnd, unsigned int)
+	{
+		for (unsigned int i = uiBegin; i < uiEnd; i++)
+		{
+			const float *pfPosition = afPosition + i * 4;
+			unsigned int uiBucket = gridBucket(pGrid, gridCell(pGrid, pfPosition[0]), gridCell(pGrid, pfPosition[1]), gridCell(pGrid, pfPosition[2]));
+			pGrid->m_auiBucket[i] = uiBucket;
+			pGrid->m_auiCursor[uiBucket].fetch_add(1, std::memory_order_relaxed);
+		}
+	});
+
+	// bucket starts, the cursors become the next free slot of each bucket
+	unsigned int uiStart = 0;
+	for (unsigned int b = 0; b < uiBuckets; b++)
+	{
+		pGrid->m_auiStart[b] = uiStart;
+		uiStart += pGrid->m_auiCursor[b].load(std::memory_order_relaxed);
+		pGrid->m_auiCursor[b].store(pGrid->m_auiStart[b], std::memory_order_relaxed);
+	}
+	pGrid->m_auiStart[uiBuckets] = uiStart;
+
+	// scatter, the order within a bucket depends on the threads until it is sorted below
+	gridFor(pPool, uiCount, [pGrid](unsigned int uiBegin, unsigned int uiEnd, unsigned int)
+	{
+		for (unsigned int i = uiBegin; i < uiEnd; i++) pGrid->m_auiOrder[pGrid->m_auiCursor[pGrid->m_auiBucket[i]].fetch_add(1, std::memory_order_relaxed)] = i;
+	});
+
+	// buckets hold a few nodes, insertion sort each into node order
+	gridFor(pPool, uiBuckets, [pGrid](unsigned int uiBegin, unsigned int uiEnd, unsigned int)
+	{
+		for (unsigned int b = uiBegin; b < uiEnd; b++)
+		{
+			unsigned int *puiOrder = pGrid->m_auiOrder;
+			for (unsigned int k = pGrid->m_auiStart[b] + 1; k < pGrid->m_auiStart[b + 1]; k++)
+			{
+				unsigned int uiNode = puiOrder[k], j = k;
+				for (; j > pGrid->m_auiStart[b] && puiOrder[j - 1] > uiNode; j--) puiOrder[j] = puiOrder[j - 1];
+				puiOrder[j] = uiNode;
+			}
+		}
+	});
+}
+
+unsigned int gridNeighbours(const raaGrid *pGrid, const float *afPosition, const float *pfPoint, float fRadius, unsigned int *auiNodes, unsigned int uiMax)
+{
+	unsigned int uiFound = 0;
+	gridQuery(pGrid, afPosition, pfPoint, fRadius, [&uiFound, auiNodes, uiMax](unsigned int uiNode, float)
+	{
+		if (auiNodes && uiFound < uiMax) auiNodes[uiFound] = uiNode;
+		uiFound++;
+	});
+	return uiFound;
+}
+
+void gridCollision(const raaGrid *pGrid, const float *afPosition, const float *afRadius, float fMaxRadius, float fStiffness, float *afForce, raaThreadPool *pPool)
+{
+	if (!pGrid || !pGrid->m_uiCount || !afRadius || !afForce) return;
+
+	gridFor(pPool, pGrid->m_uiCount, [pGrid, afPosition, afRadius, fMaxRadius, fStiffness, afForce](unsigned int uiBegin, unsigned int uiEnd, unsigned int)
+	{
+		for (unsigned int i = uiBegin; i < uiEnd; i++)
+		{
+			const float *pfPosition = afPosition + i * 4;
+			float *pfForce = afForce + i * 4;
+			float fRadius = afRadius[i];
+
+			gridQuery(pGrid, afPosition, pfPosition, fRadius + fMaxRadius, [=](unsigned int uiNode, float fDistance2)
+			{
+				float fContact = fRadius + afRadius[uiNode];
+
+				// coincident nodes have no direction to separate along, the springs and repulsion pull them apart
+				if (uiNode == i || fDistance2 >= fContact * fContact || fDistance2 <= 0.0f) return;
+
+				float fDistance = sqrtf(fDistance2);
+				float fScale = fStiffness * (fContact - fDistance) / fDistance;
+				const float *pfOther = afPosition + uiNode * 4;
+				for (int k = 0; k < 3; k++) pfForce[k] -= fScale * (pfOther[k] - pfPosition[k]);
+			});
+		}
+	});
+}
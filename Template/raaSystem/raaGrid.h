@@ -0,0 +1,86 @@
+#pragma once
+#ifdef _DEBUG
+#pragma comment(lib,"raaSystemD")
+#else
+#pragma comment(lib,"raaSystemR")
+#endif
+
+#include <math.h>
+#include "raaThreadPool.h"
+
+// uniform spatial hash grid over the node store positions for short range work - node overlap and neighbours within a
+// radius. Cubes of m_fCellSize hash into m_uiBuckets buckets, nodes counting sorted by bucket, so a build and a query are
+// O(1) per node for a bounded density. Rebuilt each step, the memory is kept between builds.
+
+const static unsigned int csg_uiGridMinBuckets = 64;
+
+typedef struct _raaGrid
+{
+	float m_fCellSize;
+	float m_fInvCellSize;
+	unsigned int m_uiCount; // nodes in the last build
+	unsigned int m_uiCapacity;
+	unsigned int m_uiBuckets; // power of two, at least twice the node count
+	unsigned int m_uiBucketCapacity;
+	unsigned int *m_auiStart; // m_uiBuckets + 1, bucket b is m_auiOrder[m_auiStart[b], m_auiStart[b + 1])
+	std::atomic<unsigned int> *m_auiCursor; // per bucket, counts then scatter positions during a build
+	unsigned int *m_auiOrder; // nodes by bucket, ascending node index within a bucket
+	unsigned int *m_auiBucket; // per node
+} raaGrid;
+
+void gridInit(raaGrid *pGrid);
+void gridDestroy(raaGrid *pGrid);
+
+// buckets uiCount nodes (4 floats each) into cubes of fCellSize, on pPool if given. The result does not depend on the pool
+void gridBuild(raaGrid *pGrid, const float *afPosition, unsigned int uiCount, float fCellSize, raaThreadPool *pPool=0);
+
+// clamped so a stray coordinate cannot overflow the cube index, the far cubes just share a bucket
+static inline int gridCell(const raaGrid *pGrid, float fCoord)
+{
+	float fCell = floorf(fCoord * pGrid->m_fInvCellSize);
+	return fCell < -1.0e9f ? -1000000000 : fCell > 1.0e9f ? 1000000000 : (int)fCell;
+}
+
+static inline unsigned int gridBucket(const raaGrid *pGrid, int iX, int iY, int iZ)
+{
+	return (((unsigned int)iX * 73856093u) ^ ((unsigned int)iY * 19349663u) ^ ((unsigned int)iZ * 83492791u)) & (pGrid->m_uiBuckets - 1);
+}
+
+// calls fVisit(uiNode, fDistance2) for every node of the last build within fRadius of pfPoint, a node at pfPoint
+// included. Nodes are visited cube by cube, in ascending index within a cube
+template<class F> void gridQuery(const raaGrid *pGrid, const float *afPosition, const float *pfPoint, float fRadius, F fVisit)
+{
+	if (!pGrid || !pGrid->m_uiCount) return;
+
+	int aiMin[3], aiMax[3];
+	for (int i = 0; i < 3; i++)
+	{
+		aiMin[i] = gridCell(pGrid, pfPoint[i] - fRadius);
+		aiMax[i] = gridCell(pGrid, pfPoint[i] + fRadius);
+	}
+
+	float fRadius2 = fRadius * fRadius;
+	for (int iZ = aiMin[2]; iZ <= aiMax[2]; iZ++) for (int iY = aiMin[1]; iY <= aiMax[1]; iY++) for (int iX = aiMin[0]; iX <= aiMax[0]; iX++)
+	{
+		unsigned int uiBucket = gridBucket(pGrid, iX, iY, iZ);
+		for (unsigned int k = pGrid->m_auiStart[uiBucket]; k < pGrid->m_auiStart[uiBucket + 1]; k++)
+		{
+			unsigned int uiNode = pGrid->m_auiOrder[k];
+			const float *pfPosition = afPosition + uiNode * 4;
+
+			// another cube hashed to this bucket
+			if (gridCell(pGrid, pfPosition[0]) != iX || gridCell(pGrid, pfPosition[1]) != iY || gridCell(pGrid, pfPosition[2]) != iZ) continue;
+
+			float afDelta[3] = { pfPosition[0] - pfPoint[0], pfPosition[1] - pfPoint[1], pfPosition[2] - pfPoint[2] };
+			float fDistance2 = afDelta[0] * afDelta[0] + afDelta[1] * afDelta[1] + afDelta[2] * afDelta[2];
+			if (fDistance2 <= fRadius2) fVisit(uiNode, fDistance2);
+		}
+	}
+}
+
+// writes up to uiMax nodes within fRadius of pfPoint to auiNodes, returns how many there are in all
+unsigned int gridNeighbours(const raaGrid *pGrid, const float *afPosition, const float *pfPoint, float fRadius, unsigned int *auiNodes, unsigned int uiMax);
+
+// pushes apart two nodes closer than the sum of their radii with fStiffness * overlap each. The cell size must be at least
+// 2 * fMaxRadius, each node gathers its own force
+void gridCollision(const raaGrid *pGrid, const float *afPosition, const float *afRadius, float fMaxRadius, float fStiffness, float *afForce, raaThreadPool *pPool=0);
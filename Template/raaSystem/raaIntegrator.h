@@ -0,0 +1,158 @@
+#pragma once
+#ifdef _DEBUG
+#pragma comment(lib,"raaSystemD")
+#else
+#pragma comment(lib,"raaSystemR")
+#endif
+
+#include "raaPrecision.h"
+
+// integrator policies for the solver, each advances one node by one stage with acceleration F/m - friction * v and is a
+// template on a precision policy (raaPrecision.h). stage() returns the squared move over the whole step on the last stage,
+// for the adaptive step, and 0 on earlier stages.
+
+// node arrays and parameters for one step, vectors are 4 reals per node, only xyz are integrated
+template<class T> struct raaIntegratorState
+{
+	T *m_atPosition;
+	T *m_atVelocity;
+	const T *m_atForce;
+	const float *m_afInvMass;
+	float *m_afCarry; // compensated precision only, 4 per node
+	T *m_atPosition0; // start of step position and velocity, and weighted stage sums (rk4)
+	T *m_atVelocity0;
+	T *m_atPositionSum;
+	T *m_atVelocitySum;
+	T m_tTimeStep;
+	T m_tFriction;
+	T m_tDamping; // legacy
+	bool m_bPrimed; // verlet, the stored velocity is already half a step ahead
+};
+
+// the original update, v = (v + F/m) * dt * (1 - damping), p += v / dt. The solver runs the simd kernels for it in float
+// precision, this is the other precisions
+template<class P> struct raaIntegratorLegacy
+{
+	typedef typename P::Real Real;
+	static const unsigned int s_uiStages = 1;
+
+	static inline float stage(const raaIntegratorState<Real> &State, unsigned int, unsigned int uiNode)
+	{
+		Real *ptPosition = State.m_atPosition + uiNode * 4;
+		Real *ptVelocity = State.m_atVelocity + uiNode * 4;
+		const Real *ptForce = State.m_atForce + uiNode * 4;
+		Real tInvMass = State.m_afInvMass[uiNode], tStep2 = 0;
+
+		for (int i = 0; i < 3; i++)
+		{
+			ptVelocity[i] = (ptVelocity[i] + ptForce[i] * tInvMass) * State.m_tTimeStep * (1 - State.m_tDamping);
+			Real tStep = ptVelocity[i] / State.m_tTimeStep;
+			ptPosition[i] = P::add(ptPosition[i], tStep, State.m_afCarry, uiNode * 4 + i);
+			tStep2 += tStep * tStep;
+		}
+		return (float)tStep2;
+	}
+};
+
+// semi-implicit (symplectic) euler - kick then drift with the new velocity
+template<class P> struct raaIntegratorEuler
+{
+	typedef typename P::Real Real;
+	static const unsigned int s_uiStages = 1;
+
+	static inline float stage(const raaIntegratorState<Real> &State, unsigned int, unsigned int uiNode)
+	{
+		Real *ptPosition = State.m_atPosition + uiNode * 4;
+		Real *ptVelocity = State.m_atVelocity + uiNode * 4;
+		const Real *ptForce = State.m_atForce + uiNode * 4;
+		Real tInvMass = State.m_afInvMass[uiNode], tStep2 = 0;
+
+		for (int i = 0; i < 3; i++)
+		{
+			ptVelocity[i] += (ptForce[i] * tInvMass - State.m_tFriction * ptVelocity[i]) * State.m_tTimeStep;
+			Real tStep = ptVelocity[i] * State.m_tTimeStep;
+			ptPosition[i] = P::add(ptPosition[i], tStep, State.m_afCarry, uiNode * 4 + i);
+			tStep2 += tStep * tStep;
+		}
+		return (float)tStep2;
+	}
+};
+
+// velocity verlet, kick-drift-kick with one force evaluation per step, the stored velocity runs half a step ahead once
+// primed
+template<class P> struct raaIntegratorVerlet
+{
+	typedef typename P::Real Real;
+	static const unsigned int s_uiStages = 1;
+
+	static inline float stage(const raaIntegratorState<Real> &State, unsigned int, unsigned int uiNode)
+	{
+		Real *ptPosition = State.m_atPosition + uiNode * 4;
+		Real *ptVelocity = State.m_atVelocity + uiNode * 4;
+		const Real *ptForce = State.m_atForce + uiNode * 4;
+		Real tInvMass = State.m_afInvMass[uiNode], tHalf = State.m_tTimeStep * (Real)0.5, tStep2 = 0;
+
+		for (int i = 0; i < 3; i++)
+		{
+			Real tAcceleration = ptForce[i] * tInvMass - State.m_tFriction * ptVelocity[i];
+			ptVelocity[i] += tAcceleration * (State.m_bPrimed ? State.m_tTimeStep : tHalf);
+			Real tStep = ptVelocity[i] * State.m_tTimeStep;
+			ptPosition[i] = P::add(ptPosition[i], tStep, State.m_afCarry, uiNode * 4 + i);
+			tStep2 += tStep * tStep;
+		}
+		return (float)tStep2;
+	}
+};
+
+// classic 4th order runge-kutta, 4 force evaluations per step. The trial positions of the inner stages are plain sums,
+// only the final position goes through the precision policy
+template<class P> struct raaIntegratorRK4
+{
+	typedef typename P::Real Real;
+	static const unsigned int s_uiStages = 4;
+
+	static inline float stage(const raaIntegratorState<Real> &State, unsigned int uiStage, unsigned int uiNode)
+	{
+		static const Real s_atWeight[4] = { 1, 2, 2, 1 };
+		static const Real s_atNext[3] = { (Real)0.5, (Real)0.5, 1 };
+
+		Real *ptPosition = State.m_atPosition + uiNode * 4;
+		Real *ptVelocity = State.m_atVelocity + uiNode * 4;
+		Real *ptPosition0 = State.m_atPosition0 + uiNode * 4;
+		Real *ptVelocity0 = State.m_atVelocity0 + uiNode * 4;
+		Real *ptPositionSum = State.m_atPositionSum + uiNode * 4;
+		Real *ptVelocitySum = State.m_atVelocitySum + uiNode * 4;
+		const Real *ptForce = State.m_atForce + uiNode * 4;
+		Real tInvMass = State.m_afInvMass[uiNode], tStep2 = 0;
+
+		for (int i = 0; i < 3; i++)
+		{
+			// derivative at this stage's state
+			Real tDx = ptVelocity[i];
+			Real tDv = ptForce[i] * tInvMass - State.m_tFriction * ptVelocity[i];
+
+			if (!uiStage)
+			{
+				ptPosition0[i] = ptPosition[i];
+				ptVelocity0[i] = ptVelocity[i];
+				ptPositionSum[i] = ptVelocitySum[i] = 0;
+			}
+			ptPositionSum[i] += tDx * s_atWeight[uiStage];
+			ptVelocitySum[i] += tDv * s_atWeight[uiStage];
+
+			if (uiStage < 3)
+			{
+				ptPosition[i] = ptPosition0[i] + tDx * State.m_tTimeStep * s_atNext[uiStage];
+				ptVelocity[i] = ptVelocity0[i] + tDv * State.m_tTimeStep * s_atNext[uiStage];
+			}
+			else
+			{
+				Real tStep = ptPositionSum[i] * State.m_tTimeStep / 6;
+				ptPosition[i] = P::add(ptPosition0[i], tStep, State.m_afCarry, uiNode * 4 + i);
+				ptVelocity[i] = ptVelocity0[i] + ptVelocitySum[i] * State.m_tTimeStep / 6;
+				tStep2 += tStep * tStep;
+			}
+		}
+		return (float)tStep2;
+	}
+};
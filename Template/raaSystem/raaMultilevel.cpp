@@ -0,0 +1,237 @@
+#include "stdafx.h"
+#include <string.h>
+#include "raaMultilevel.h"
+
+void multilevelInit(raaMultilevel* pML)
+{
+	if (pML)
+	{
+		memset(pML, 0, sizeof(raaMultilevel));
+		pML->m_uiCoarsestSteps = csg_uiMultilevelDefaultCoarsestSteps;
+		pML->m_uiRefineSteps = csg_uiMultilevelDefaultRefineSteps;
+		pML->m_fJitter = csg_fMultilevelDefaultJitter;
+	}
+}
+
+static void multilevelRelease(raaMultilevel *pML)
+{
+	for (unsigned int l = 0; l < pML->m_uiLevels; l++)
+	{
+		destroySystem(pML->m_aLevel + l);
+		delete[] pML->m_aauiParent[l];
+		pML->m_aauiParent[l] = 0;
+	}
+	pML->m_uiLevels = 0;
+}
+
+void multilevelDestroy(raaMultilevel* pML)
+{
+	if (pML) multilevelRelease(pML);
+}
+
+// collapses pFine into pCoarse, auiParent gets the coarse index of every fine node. Returns the coarse node count.
+static unsigned int multilevelCoarsen(raaSystem *pFine, raaSystem *pCoarse, unsigned int *auiParent)
+{
+	updateAdjacency(pFine);
+
+	const raaTopology *pTopology = &(pFine->m_Topology);
+	const raaNodeStore *pStore = &(pFine->m_Nodes);
+	unsigned int uiNodes = pStore->m_uiCount, uiCoarse = 0;
+	const unsigned int *auiOffset = pTopology->m_auiOffset;
+
+	// visit in ascending degree so leaves and chains pair up before the hubs take their neighbours
+	unsigned int uiMaxDegree = 0;
+	for (unsigned int i = 0; i < uiNodes; i++) if (auiOffset[i + 1] - auiOffset[i] > uiMaxDegree) uiMaxDegree = auiOffset[i + 1] - auiOffset[i];
+
+	unsigned int *auiBucket = new unsigned int[uiMaxDegree + 2];
+	unsigned int *auiOrder = new unsigned int[uiNodes];
+	unsigned int *auiSize = new unsigned int[uiNodes];
+	memset(auiBucket, 0, sizeof(unsigned int) * (uiMaxDegree + 2));
+	for (unsigned int i = 0; i < uiNodes; i++) auiBucket[auiOffset[i + 1] - auiOffset[i] + 1]++;
+	for (unsigned int d = 1; d < uiMaxDegree + 2; d++) auiBucket[d] += auiBucket[d - 1];
+	for (unsigned int i = 0; i < uiNodes; i++) auiOrder[auiBucket[auiOffset[i + 1] - auiOffset[i]]++] = i;
+
+	memset(auiParent, 0xff, sizeof(unsigned int) * uiNodes);
+
+	// heavy arc matching
+	for (unsigned int k = 0; k < uiNodes; k++)
+	{
+		unsigned int i = auiOrder[k], uiBest = csg_uiInvalidIndex;
+		float fBest = 0.0f;
+
+		if (auiParent[i] != csg_uiInvalidIndex) continue;
+
+		for (unsigned int j = auiOffset[i]; j < auiOffset[i + 1]; j++)
+		{
+			unsigned int uiNeighbour = pTopology->m_auiNeighbour[j];
+			if (uiNeighbour != i && auiParent[uiNeighbour] == csg_uiInvalidIndex && (uiBest == csg_uiInvalidIndex || pTopology->m_afSpringCoef[j] > fBest))
+			{
+				uiBest = uiNeighbour;
+				fBest = pTopology->m_afSpringCoef[j];
+			}
+		}
+
+		if (uiBest != csg_uiInvalidIndex)
+		{
+			auiParent[i] = auiParent[uiBest] = uiCoarse;
+			auiSize[uiCoarse++] = 2;
+		}
+	}
+
+	// unmatched nodes join their most strongly sprung neighbouring cluster, or stay on their own
+	for (unsigned int k = 0; k < uiNodes; k++)
+	{
+		unsigned int i = auiOrder[k], uiBest = csg_uiInvalidIndex;
+		float fBest = 0.0f;
+
+		if (auiParent[i] != csg_uiInvalidIndex) continue;
+
+		for (unsigned int j = auiOffset[i]; j < auiOffset[i + 1]; j++)
+		{
+			unsigned int uiCluster = auiParent[pTopology->m_auiNeighbour[j]];
+			if (uiCluster != csg_uiInvalidIndex && auiSize[uiCluster] < csg_uiMultilevelMaxCluster && (uiBest == csg_uiInvalidIndex || pTopology->m_afSpringCoef[j] > fBest))
+			{
+				uiBest = uiCluster;
+				fBest = pTopology->m_afSpringCoef[j];
+			}
+		}
+
+		if (uiBest != csg_uiInvalidIndex)
+		{
+			auiParent[i] = uiBest;
+			auiSize[uiBest]++;
+		}
+		else
+		{
+			auiParent[i] = uiCoarse;
+			auiSize[uiCoarse++] = 1;
+		}
+	}
+
+	// coarse nodes at the centre of mass of their cluster, massless (pinned) nodes count with unit weight
+	float *afCentre = new float[uiCoarse * 4];
+	float *afMass = new float[uiCoarse];
+	memset(afCentre, 0, sizeof(float) * uiCoarse * 4);
+	memset(afMass, 0, sizeof(float) * uiCoarse);
+
+	for (unsigned int i = 0; i < uiNodes; i++)
+	{
+		float fMass = pStore->m_apNode[i]->m_fMass;
+		float fWeight = fMass > 0.0f ? fMass : 1.0f;
+		float *pfCentre = afCentre + auiParent[i] * 4;
+
+		for (int j = 0; j < 3; j++) pfCentre[j] += pStore->m_afPosition[i * 4 + j] * fWeight;
+		pfCentre[3] += fWeight;
+		afMass[auiParent[i]] += fMass;
+	}
+
+	initSystem(pCoarse, false);
+	reserveNodes(pCoarse, uiCoarse);
+	for (unsigned int c = 0; c < uiCoarse; c++)
+	{
+		float *pfCentre = afCentre + c * 4;
+		for (int j = 0; j < 3; j++) pfCentre[j] /= pfCentre[3];
+		pfCentre[3] = 1.0f;
+		addNode(pCoarse, initNode(allocNode(pCoarse), c + 1, pfCentre, afMass[c]));
+	}
+
+	for (unsigned int uiArc = 0; uiArc < pTopology->m_uiArcCount; uiArc++)
+	{
+		unsigned int uiParent0 = auiParent[pTopology->m_auiArcNode0[uiArc]];
+		unsigned int uiParent1 = auiParent[pTopology->m_auiArcNode1[uiArc]];
+
+		if (uiParent0 != uiParent1) addArc(pCoarse, initArc(allocArc(pCoarse), pCoarse->m_Nodes.m_apNode[uiParent0], pCoarse->m_Nodes.m_apNode[uiParent1], pTopology->m_afArcSpringCoef[uiArc], pTopology->m_afArcIdealLen[uiArc]));
+	}
+
+	mergeArcs(pCoarse, csg_uiArcMergeSum);
+	buildTopology(pCoarse);
+
+	delete[] auiBucket;
+	delete[] auiOrder;
+	delete[] auiSize;
+	delete[] afCentre;
+	delete[] afMass;
+
+	return uiCoarse;
+}
+
+unsigned int multilevelBuild(raaMultilevel* pML, raaSystem* pSystem)
+{
+	if (pML && pSystem)
+	{
+		multilevelRelease(pML);
+		if (!pSystem->m_Topology.m_bValid) buildTopology(pSystem);
+
+		raaSystem *pFine = pSystem;
+		while (pML->m_uiLevels < csg_uiMultilevelMaxLevels && pFine->m_Nodes.m_uiCount > csg_uiMultilevelMinNodes)
+		{
+			unsigned int uiNodes = pFine->m_Nodes.m_uiCount;
+			unsigned int *auiParent = new unsigned int[uiNodes];
+			raaSystem *pCoarse = pML->m_aLevel + pML->m_uiLevels;
+
+			if (multilevelCoarsen(pFine, pCoarse, auiParent) > (unsigned int)(csg_fMultilevelMinShrink * uiNodes))
+			{
+				// matching has stalled (eg a graph of disconnected nodes), the previous level is the coarsest
+				destroySystem(pCoarse);
+				delete[] auiParent;
+				break;
+			}
+
+			pML->m_aauiParent[pML->m_uiLevels++] = auiParent;
+			pFine = pCoarse;
+		}
+		return pML->m_uiLevels;
+	}
+	return 0;
+}
+
+// places each fine node at its parent with a small deterministic offset so collapsed nodes separate, pinned nodes stay put
+static void multilevelProlong(const raaSystem *pCoarse, raaSystem *pFine, const unsigned int *auiParent, float fJitter)
+{
+	const raaTopology *pTopology = &(pFine->m_Topology);
+	raaNodeStore *pStore = &(pFine->m_Nodes);
+	float fIdeal = 0.0f;
+
+	for (unsigned int uiArc = 0; uiArc < pTopology->m_uiArcCount; uiArc++) fIdeal += pTopology->m_afArcIdealLen[uiArc];
+	fIdeal = pTopology->m_uiArcCount ? fIdeal / pTopology->m_uiArcCount : 1.0f;
+
+	for (unsigned int i = 0; i < pStore->m_uiCount; i++)
+	{
+		float *pfPosition = pStore->m_afPosition + i * 4;
+		const float *pfParent = pCoarse->m_Nodes.m_afPosition + auiParent[i] * 4;
+		unsigned int uiHash = i * 2654435761u;
+
+		if (pStore->m_afInvMass[i] > 0.0f) for (int j = 0; j < 3; j++)
+		{
+			uiHash = uiHash * 1664525u + 1013904223u;
+			pfPosition[j] = pfParent[j] + ((float)(uiHash >> 8) / (float)(1 << 24) * 2.0f - 1.0f) * fJitter * fIdeal;
+		}
+
+		float *pfVelocity = pStore->m_afVelocity + i * 4;
+		pfVelocity[0] = pfVelocity[1] = pfVelocity[2] = 0.0f;
+	}
+}
+
+static void multilevelRelax(raaSolver *pSolver, raaSystem *pSystem, unsigned int uiSteps)
+{
+	// new positions for the solver
+	solverWake(pSolver);
+	for (unsigned int i = 0; i < uiSteps && !solverConverged(pSolver); i++) solverStep(pSolver, pSystem);
+}
+
+void multilevelLayout(raaMultilevel* pML, raaSystem* pSystem, raaSolver* pSolver)
+{
+	if (pML && pSystem && pSolver)
+	{
+		multilevelBuild(pML, pSystem);
+
+		multilevelRelax(pSolver, pML->m_uiLevels ? pML->m_aLevel + pML->m_uiLevels - 1 : pSystem, pML->m_uiCoarsestSteps);
+
+		for (unsigned int l = pML->m_uiLevels; l-- > 0;)
+		{
+			raaSystem *pFine = l ? pML->m_aLevel + l - 1 : pSystem;
+			multilevelProlong(pML->m_aLevel + l, pFine, pML->m_aauiParent[l], pML->m_fJitter);
+			multilevelRelax(pSolver, pFine, pML->m_uiRefineSteps);
+		}
+	}
+}
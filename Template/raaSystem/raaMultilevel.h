@@ -0,0 +1,43 @@
+#pragma once
+#ifdef _DEBUG
+#pragma comment(lib,"raaSystemD")
+#else
+#pragma comment(lib,"raaSystemR")
+#endif
+
+#include "raaSystem.h"
+#include "raaSolver.h"
+
+// multilevel layout. The system is repeatedly coarsened into smaller systems - heavy arc matching pairs each node with the
+// unmatched neighbour it is most strongly sprung to, nodes left over join a neighbouring cluster, and every cluster becomes
+// one node with the summed mass at the centre of mass, its arcs merged with csg_uiArcMergeSum. The coarsest system is laid
+// out with the solver, then each finer level starts from its parent's position plus a small offset and is refined with the
+// same solver, so the global shape is found on a few hundred nodes and the big levels only need local settling.
+
+const static unsigned int csg_uiMultilevelMaxLevels = 32;
+const static unsigned int csg_uiMultilevelMinNodes = 64; // coarsening stops at this size
+const static float csg_fMultilevelMinShrink = 0.85f; // or when a level keeps more than this fraction of its nodes
+const static unsigned int csg_uiMultilevelMaxCluster = 8; // nodes collapsed into one coarse node, bounds hub clusters
+const static unsigned int csg_uiMultilevelDefaultCoarsestSteps = 2000;
+const static unsigned int csg_uiMultilevelDefaultRefineSteps = 200;
+const static float csg_fMultilevelDefaultJitter = 0.1f; // prolongation offset as a fraction of the mean ideal arc length
+
+typedef struct _raaMultilevel
+{
+	raaSystem m_aLevel[csg_uiMultilevelMaxLevels]; // m_aLevel[0] is the first coarsening of the input system
+	unsigned int *m_aauiParent[csg_uiMultilevelMaxLevels]; // [l] maps the nodes of the level below m_aLevel[l] to their parents in it
+	unsigned int m_uiLevels;
+	unsigned int m_uiCoarsestSteps; // solver steps, each level stops early once the solver has converged
+	unsigned int m_uiRefineSteps;
+	float m_fJitter;
+} raaMultilevel;
+
+void multilevelInit(raaMultilevel *pML);
+void multilevelDestroy(raaMultilevel *pML);
+
+// builds the hierarchy for pSystem, replacing any previous one, returns the number of coarse levels
+unsigned int multilevelBuild(raaMultilevel *pML, raaSystem *pSystem);
+
+// builds the hierarchy and lays pSystem out through it with pSolver, which keeps its settings (integrator, repulsion...)
+// for every level. The hierarchy is kept until the next build or multilevelDestroy.
+void multilevelLayout(raaMultilevel *pML, raaSystem *pSystem, raaSolver *pSolver);
@@ -0,0 +1,103 @@
+#include "stdafx.h"
+#include <string.h>
+#include "raaNameTable.h"
+
+static unsigned int nameHash(const char *acName)
+{
+	// fnv-1a
+	unsigned int uiHash = 2166136261u;
+	for (; *acName; acName++) uiHash = (uiHash ^ (unsigned char)*acName) * 16777619u;
+	return uiHash;
+}
+
+static void nameTableRehash(raaNameTable *pTable, unsigned int uiSlots)
+{
+	unsigned int *auiSlot = new unsigned int[uiSlots];
+	memset(auiSlot, 0, sizeof(unsigned int)*uiSlots);
+
+	for (unsigned int i = 0; i < pTable->m_uiSlots; i++)
+	{
+		if (pTable->m_auiSlot[i])
+		{
+			unsigned int uiSlot = nameHash(pTable->m_acText + pTable->m_auiSlot[i]) & (uiSlots - 1);
+			while (auiSlot[uiSlot]) uiSlot = (uiSlot + 1) & (uiSlots - 1);
+			auiSlot[uiSlot] = pTable->m_auiSlot[i];
+		}
+	}
+
+	delete[] pTable->m_auiSlot;
+	pTable->m_auiSlot = auiSlot;
+	pTable->m_uiSlots = uiSlots;
+}
+
+void nameTableInit(raaNameTable* pTable)
+{
+	if (pTable)
+	{
+		pTable->m_acText = new char[csg_uiNameTableMinCapacity];
+		pTable->m_acText[0] = 0;
+		pTable->m_uiSize = 1;
+		pTable->m_uiCapacity = csg_uiNameTableMinCapacity;
+		pTable->m_auiSlot = new unsigned int[csg_uiNameTableMinSlots];
+		memset(pTable->m_auiSlot, 0, sizeof(unsigned int)*csg_uiNameTableMinSlots);
+		pTable->m_uiSlots = csg_uiNameTableMinSlots;
+		pTable->m_uiNames = 0;
+	}
+}
+
+void nameTableDestroy(raaNameTable* pTable)
+{
+	if (pTable)
+	{
+		delete[] pTable->m_acText;
+		delete[] pTable->m_auiSlot;
+		memset(pTable, 0, sizeof(raaNameTable));
+	}
+}
+
+void nameTableReset(raaNameTable* pTable)
+{
+	if (pTable && pTable->m_acText)
+	{
+		pTable->m_uiSize = 1;
+		pTable->m_uiNames = 0;
+		memset(pTable->m_auiSlot, 0, sizeof(unsigned int)*pTable->m_uiSlots);
+	}
+}
+
+unsigned int nameTableIntern(raaNameTable* pTable, const char* acName)
+{
+	if (!pTable || !pTable->m_acText || !acName || !*acName) return 0;
+
+	unsigned int uiSlot = nameHash(acName) & (pTable->m_uiSlots - 1);
+	for (; pTable->m_auiSlot[uiSlot]; uiSlot = (uiSlot + 1) & (pTable->m_uiSlots - 1))
+		if (!strcmp(pTable->m_acText + pTable->m_auiSlot[uiSlot], acName)) return pTable->m_auiSlot[uiSlot];
+
+	unsigned int uiLen = (unsigned int)strlen(acName) + 1;
+	if (pTable->m_uiSize + uiLen > pTable->m_uiCapacity)
+	{
+		unsigned int uiCapacity = pTable->m_uiCapacity * 2;
+		while (pTable->m_uiSize + uiLen > uiCapacity) uiCapacity *= 2;
+
+		char *acText = new char[uiCapacity];
+		memcpy(acText, pTable->m_acText, pTable->m_uiSize);
+		delete[] pTable->m_acText;
+		pTable->m_acText = acText;
+		pTable->m_uiCapacity = uiCapacity;
+	}
+
+	unsigned int uiName = pTable->m_uiSize;
+	memcpy(pTable->m_acText + uiName, acName, uiLen);
+	pTable->m_uiSize += uiLen;
+	pTable->m_auiSlot[uiSlot] = uiName;
+
+	// keep the load under a half so probe runs stay short
+	if (++pTable->m_uiNames * 2 > pTable->m_uiSlots) nameTableRehash(pTable, pTable->m_uiSlots * 2);
+
+	return uiName;
+}
+
+const char* nameTableString(raaNameTable* pTable, unsigned int uiName)
+{
+	return pTable && pTable->m_acText && uiName < pTable->m_uiSize ? pTable->m_acText + uiName : "";
+}
@@ -0,0 +1,29 @@
+#pragma once
+#ifdef _DEBUG
+#pragma comment(lib,"raaSystemD")
+#else
+#pragma comment(lib,"raaSystemR")
+#endif
+
+// interned string table - each distinct name is stored once, nul terminated, in one contiguous buffer and referred to by
+// its offset. Offset 0 is always the empty string. The strings can be handed straight to the text renderer.
+
+const static unsigned int csg_uiNameTableMinCapacity = 4096; // bytes
+const static unsigned int csg_uiNameTableMinSlots = 256;
+
+typedef struct _raaNameTable
+{
+	char *m_acText;
+	unsigned int m_uiSize; // bytes used
+	unsigned int m_uiCapacity;
+	unsigned int *m_auiSlot; // open addressed hash of offsets, 0 marks an empty slot
+	unsigned int m_uiSlots; // power of 2
+	unsigned int m_uiNames;
+} raaNameTable;
+
+void nameTableInit(raaNameTable *pTable);
+void nameTableDestroy(raaNameTable *pTable);
+void nameTableReset(raaNameTable *pTable); // forgets every name but keeps the memory
+
+unsigned int nameTableIntern(raaNameTable *pTable, const char *acName);
+const char* nameTableString(raaNameTable *pTable, unsigned int uiName);
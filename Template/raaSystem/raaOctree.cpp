@@ -0,0 +1,220 @@
+#include "stdafx.h"
+#include <math.h>
+#include <string.h>
+#include "raaOctree.h"
+
+static unsigned int octreeAddCells(raaOctree *pTree, unsigned int uiCount)
+{
+	if (pTree->m_uiCells + uiCount > pTree->m_uiCellCapacity)
+	{
+		unsigned int uiCapacity = pTree->m_uiCellCapacity ? pTree->m_uiCellCapacity * 2 : 1024;
+		while (uiCapacity < pTree->m_uiCells + uiCount) uiCapacity *= 2;
+
+		raaOctreeCell *aCell = new raaOctreeCell[uiCapacity];
+		if (pTree->m_aCell)
+		{
+			memcpy(aCell, pTree->m_aCell, sizeof(raaOctreeCell)*pTree->m_uiCells);
+			delete[] pTree->m_aCell;
+		}
+		pTree->m_aCell = aCell;
+		pTree->m_uiCellCapacity = uiCapacity;
+	}
+
+	unsigned int uiFirst = pTree->m_uiCells;
+	pTree->m_uiCells += uiCount;
+	return uiFirst;
+}
+
+void octreeInit(raaOctree* pTree, unsigned int uiLeafSize)
+{
+	if (pTree)
+	{
+		memset(pTree, 0, sizeof(raaOctree));
+		pTree->m_uiLeafSize = uiLeafSize ? uiLeafSize : 1;
+	}
+}
+
+void octreeDestroy(raaOctree* pTree)
+{
+	if (pTree)
+	{
+		delete[] pTree->m_aCell;
+		delete[] pTree->m_auiOrder;
+		delete[] pTree->m_auiScratch;
+		delete[] pTree->m_aucOctant;
+		octreeInit(pTree, pTree->m_uiLeafSize);
+	}
+}
+
+void octreeBuild(raaOctree* pTree, const float* afPosition, unsigned int uiCount)
+{
+	if (!pTree) return;
+
+	pTree->m_uiCells = 0;
+	pTree->m_uiCount = uiCount;
+	if (!uiCount) return;
+
+	if (uiCount > pTree->m_uiCapacity)
+	{
+		delete[] pTree->m_auiOrder;
+		delete[] pTree->m_auiScratch;
+		delete[] pTree->m_aucOctant;
+		pTree->m_auiOrder = new unsigned int[uiCount];
+		pTree->m_auiScratch = new unsigned int[uiCount];
+		pTree->m_aucOctant = new unsigned char[uiCount];
+		pTree->m_uiCapacity = uiCount;
+	}
+
+	// bounding cube of all the nodes
+	float afMin[3], afMax[3];
+	for (int i = 0; i < 3; i++) afMin[i] = afMax[i] = afPosition[i];
+	for (unsigned int n = 0; n < uiCount; n++)
+	{
+		pTree->m_auiOrder[n] = n;
+		for (int i = 0; i < 3; i++)
+		{
+			float f = afPosition[n * 4 + i];
+			if (f < afMin[i]) afMin[i] = f;
+			if (f > afMax[i]) afMax[i] = f;
+		}
+	}
+
+	float fHalf = 0.0f;
+	for (int i = 0; i < 3; i++) if ((afMax[i] - afMin[i]) * 0.5f > fHalf) fHalf = (afMax[i] - afMin[i]) * 0.5f;
+	fHalf = fHalf * 1.001f + 1.0e-3f;
+
+	octreeAddCells(pTree, 1);
+	raaOctreeCell *pRoot = pTree->m_aCell;
+	for (int i = 0; i < 3; i++) pRoot->m_afCentre[i] = (afMin[i] + afMax[i]) * 0.5f;
+	pRoot->m_afCentre[3] = fHalf;
+	pRoot->m_uiBegin = 0;
+	pRoot->m_uiEnd = uiCount;
+	pRoot->m_uiChild = pRoot->m_uiChildCount = 0;
+
+	// top down subdivision - children are created together so they are contiguous and always after their parent
+	float fMinHalf = fHalf / (float)(1u << (csg_uiOctreeMaxDepth - 1));
+	for (unsigned int c = 0; c < pTree->m_uiCells; c++)
+	{
+		raaOctreeCell *pCell = pTree->m_aCell + c;
+		unsigned int uiBegin = pCell->m_uiBegin, uiEnd = pCell->m_uiEnd;
+
+		if (uiEnd - uiBegin <= pTree->m_uiLeafSize || pCell->m_afCentre[3] <= fMinHalf) continue;
+
+		unsigned int auiCount[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+		for (unsigned int n = uiBegin; n < uiEnd; n++)
+		{
+			const float *pfP = afPosition + pTree->m_auiOrder[n] * 4;
+			unsigned char ucOctant = (pfP[0] >= pCell->m_afCentre[0] ? 1 : 0) | (pfP[1] >= pCell->m_afCentre[1] ? 2 : 0) | (pfP[2] >= pCell->m_afCentre[2] ? 4 : 0);
+			pTree->m_aucOctant[n] = ucOctant;
+			auiCount[ucOctant]++;
+		}
+
+		unsigned int auiStart[8], uiChildren = 0;
+		for (unsigned int o = 0, uiStart = uiBegin; o < 8; o++)
+		{
+			auiStart[o] = uiStart;
+			uiStart += auiCount[o];
+			if (auiCount[o]) uiChildren++;
+		}
+
+		unsigned int auiFill[8];
+		memcpy(auiFill, auiStart, sizeof(auiFill));
+		for (unsigned int n = uiBegin; n < uiEnd; n++) pTree->m_auiScratch[auiFill[pTree->m_aucOctant[n]]++] = pTree->m_auiOrder[n];
+		memcpy(pTree->m_auiOrder + uiBegin, pTree->m_auiScratch + uiBegin, sizeof(unsigned int)*(uiEnd - uiBegin));
+
+		unsigned int uiChild = octreeAddCells(pTree, uiChildren);
+		pCell = pTree->m_aCell + c;
+		pCell->m_uiChild = uiChild;
+		pCell->m_uiChildCount = uiChildren;
+
+		float fChildHalf = pCell->m_afCentre[3] * 0.5f;
+		for (unsigned int o = 0; o < 8; o++)
+		{
+			if (auiCount[o])
+			{
+				raaOctreeCell *pChild = pTree->m_aCell + uiChild++;
+				pChild->m_afCentre[0] = pCell->m_afCentre[0] + (o & 1 ? fChildHalf : -fChildHalf);
+				pChild->m_afCentre[1] = pCell->m_afCentre[1] + (o & 2 ? fChildHalf : -fChildHalf);
+				pChild->m_afCentre[2] = pCell->m_afCentre[2] + (o & 4 ? fChildHalf : -fChildHalf);
+				pChild->m_afCentre[3] = fChildHalf;
+				pChild->m_uiBegin = auiStart[o];
+				pChild->m_uiEnd = auiStart[o] + auiCount[o];
+				pChild->m_uiChild = pChild->m_uiChildCount = 0;
+			}
+		}
+	}
+
+	// bottom up centres of charge
+	for (unsigned int c = pTree->m_uiCells; c-- > 0;)
+	{
+		raaOctreeCell *pCell = pTree->m_aCell + c;
+		double adSum[3] = { 0.0, 0.0, 0.0 };
+
+		if (!pCell->m_uiChild)
+		{
+			for (unsigned int n = pCell->m_uiBegin; n < pCell->m_uiEnd; n++)
+				for (int i = 0; i < 3; i++) adSum[i] += afPosition[pTree->m_auiOrder[n] * 4 + i];
+		}
+		else
+		{
+			for (unsigned int k = 0; k < pCell->m_uiChildCount; k++)
+			{
+				raaOctreeCell *pChild = pTree->m_aCell + pCell->m_uiChild + k;
+				for (int i = 0; i < 3; i++) adSum[i] += (double)pChild->m_afCharge[i] * pChild->m_afCharge[3];
+			}
+		}
+
+		pCell->m_afCharge[3] = (float)(pCell->m_uiEnd - pCell->m_uiBegin);
+		for (int i = 0; i < 3; i++) pCell->m_afCharge[i] = (float)(adSum[i] / pCell->m_afCharge[3]);
+	}
+}
+
+void octreeRepulsion(const raaOctree* pTree, const float* afPosition, unsigned int uiNode, float fTheta, float fCharge, float fSoftening, float* pfForce)
+{
+	if (!pTree || !pTree->m_uiCells) return;
+
+	const float *pfP = afPosition + uiNode * 4;
+	float fTheta2 = fTheta * fTheta;
+	float fSoftening2 = fSoftening * fSoftening;
+	float afForce[3] = { 0.0f, 0.0f, 0.0f };
+	unsigned int auiStack[csg_uiOctreeMaxDepth * 8];
+	unsigned int uiStack = 0;
+
+	auiStack[uiStack++] = 0;
+	while (uiStack)
+	{
+		const raaOctreeCell *pCell = pTree->m_aCell + auiStack[--uiStack];
+		float afD[3] = { pfP[0] - pCell->m_afCharge[0], pfP[1] - pCell->m_afCharge[1], pfP[2] - pCell->m_afCharge[2] };
+		float fR2 = afD[0] * afD[0] + afD[1] * afD[1] + afD[2] * afD[2];
+		float fSize = pCell->m_afCentre[3] * 2.0f;
+
+		if (pCell->m_uiChild && fSize * fSize < fTheta2 * fR2)
+		{
+			// far enough away to act as one charge
+			fR2 += fSoftening2;
+			float fScale = pCell->m_afCharge[3] / (fR2 * sqrtf(fR2));
+			for (int i = 0; i < 3; i++) afForce[i] += afD[i] * fScale;
+		}
+		else if (pCell->m_uiChild)
+		{
+			for (unsigned int k = 0; k < pCell->m_uiChildCount; k++) auiStack[uiStack++] = pCell->m_uiChild + k;
+		}
+		else
+		{
+			for (unsigned int n = pCell->m_uiBegin; n < pCell->m_uiEnd; n++)
+			{
+				unsigned int uiOther = pTree->m_auiOrder[n];
+				if (uiOther != uiNode)
+				{
+					const float *pfQ = afPosition + uiOther * 4;
+					float afE[3] = { pfP[0] - pfQ[0], pfP[1] - pfQ[1], pfP[2] - pfQ[2] };
+					float fE2 = afE[0] * afE[0] + afE[1] * afE[1] + afE[2] * afE[2] + fSoftening2;
+					float fScale = 1.0f / (fE2 * sqrtf(fE2));
+					for (int i = 0; i < 3; i++) afForce[i] += afE[i] * fScale;
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < 3; i++) pfForce[i] += afForce[i] * fCharge;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#ifdef _DEBUG
+#pragma comment(lib,"raaSystemD")
+#else
+#pragma comment(lib,"raaSystemR")
+#endif
+
+// octree over the node store positions for the long range repulsion. Cells are stored in one array with the children of a
+// cell contiguous, nodes are reordered (m_auiOrder) so every cell covers a contiguous range. Every node carries unit charge
+// so the charge of a cell is its node count. Rebuilt each step, the memory is kept between builds.
+
+const static unsigned int csg_uiOctreeDefaultLeafSize = 8;
+const static unsigned int csg_uiOctreeMaxDepth = 32; // also bounds the traversal stack, coincident nodes stop subdividing here
+
+typedef struct _raaOctreeCell
+{
+	float m_afCentre[4]; // geometric centre, w is the half edge length
+	float m_afCharge[4]; // centre of charge, w is the total charge
+	unsigned int m_uiBegin; // node range in m_auiOrder
+	unsigned int m_uiEnd;
+	unsigned int m_uiChild; // first child, 0 for a leaf (the root is cell 0 so is never a child)
+	unsigned int m_uiChildCount;
+} raaOctreeCell;
+
+typedef struct _raaOctree
+{
+	raaOctreeCell *m_aCell;
+	unsigned int m_uiCells;
+	unsigned int m_uiCellCapacity;
+	unsigned int *m_auiOrder; // tree order -> dense node index
+	unsigned int *m_auiScratch;
+	unsigned char *m_aucOctant;
+	unsigned int m_uiCount;
+	unsigned int m_uiCapacity;
+	unsigned int m_uiLeafSize;
+} raaOctree;
+
+void octreeInit(raaOctree *pTree, unsigned int uiLeafSize=csg_uiOctreeDefaultLeafSize);
+void octreeDestroy(raaOctree *pTree);
+void octreeBuild(raaOctree *pTree, const float *afPosition, unsigned int uiCount);
+
+// barnes-hut repulsion on one node, cells smaller than fTheta times their distance are treated as a single charge.
+// Adds fCharge * d / (|d|^2 + fSoftening^2)^1.5 per (approximated) node to pfForce
+void octreeRepulsion(const raaOctree *pTree, const float *afPosition, unsigned int uiNode, float fTheta, float fCharge, float fSoftening, float *pfForce);
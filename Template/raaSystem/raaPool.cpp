@@ -0,0 +1,92 @@
+#include "stdafx.h"
+#include <string.h>
+#include "raaSystem.h"
+#include "raaPool.h"
+
+// first item in a slab starts after the header, rounded up to the item alignment
+const static unsigned int csg_uiPoolSlabHeader = (sizeof(raaPoolSlab) + csg_uiPoolItemAlignment - 1) & ~(csg_uiPoolItemAlignment - 1);
+
+void poolInit(raaPool* pPool, unsigned int uiItemSize, unsigned int uiSlabSize)
+{
+	if (pPool)
+	{
+		memset(pPool, 0, sizeof(raaPool));
+		if (uiItemSize < sizeof(void*)) uiItemSize = sizeof(void*);
+		pPool->m_uiItemSize = (uiItemSize + csg_uiPoolItemAlignment - 1) & ~(csg_uiPoolItemAlignment - 1);
+		pPool->m_uiItemsPerSlab = uiSlabSize > csg_uiPoolSlabHeader + pPool->m_uiItemSize ? (uiSlabSize - csg_uiPoolSlabHeader) / pPool->m_uiItemSize : 1;
+		pPool->m_uiSlabUsed = pPool->m_uiItemsPerSlab;
+	}
+}
+
+void* poolAlloc(raaPool* pPool)
+{
+	void *pItem = 0;
+
+	if (pPool && pPool->m_uiItemSize)
+	{
+		if (pPool->m_pFree)
+		{
+			pItem = pPool->m_pFree;
+			pPool->m_pFree = *(void**)pItem;
+		}
+		else
+		{
+			if (pPool->m_uiSlabUsed == pPool->m_uiItemsPerSlab)
+			{
+				raaPoolSlab *pSlab = pPool->m_pSpare;
+				if (pSlab) pPool->m_pSpare = pSlab->m_pNext;
+				else pSlab = (raaPoolSlab*)systemAlignedAlloc(csg_uiPoolSlabHeader + pPool->m_uiItemSize*pPool->m_uiItemsPerSlab);
+
+				pSlab->m_pNext = pPool->m_pSlabs;
+				pPool->m_pSlabs = pSlab;
+				pPool->m_uiSlabUsed = 0;
+			}
+			pItem = ((char*)pPool->m_pSlabs) + csg_uiPoolSlabHeader + pPool->m_uiItemSize*pPool->m_uiSlabUsed++;
+		}
+		pPool->m_uiCount++;
+	}
+	return pItem;
+}
+
+void poolFree(raaPool* pPool, void* pItem)
+{
+	if (pPool && pItem)
+	{
+		*(void**)pItem = pPool->m_pFree;
+		pPool->m_pFree = pItem;
+		pPool->m_uiCount--;
+	}
+}
+
+void poolReset(raaPool* pPool, bool bKeepSlabs)
+{
+	if (pPool)
+	{
+		while (pPool->m_pSlabs)
+		{
+			raaPoolSlab *pSlab = pPool->m_pSlabs;
+			pPool->m_pSlabs = pSlab->m_pNext;
+
+			if (bKeepSlabs)
+			{
+				pSlab->m_pNext = pPool->m_pSpare;
+				pPool->m_pSpare = pSlab;
+			}
+			else systemAlignedFree(pSlab);
+		}
+
+		if (!bKeepSlabs)
+		{
+			while (pPool->m_pSpare)
+			{
+				raaPoolSlab *pSlab = pPool->m_pSpare;
+				pPool->m_pSpare = pSlab->m_pNext;
+				systemAlignedFree(pSlab);
+			}
+		}
+
+		pPool->m_pFree = 0;
+		pPool->m_uiCount = 0;
+		pPool->m_uiSlabUsed = pPool->m_uiItemsPerSlab;
+	}
+}
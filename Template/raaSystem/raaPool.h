@@ -0,0 +1,33 @@
+#pragma once
+#ifdef _DEBUG
+#pragma comment(lib,"raaSystemD")
+#else
+#pragma comment(lib,"raaSystemR")
+#endif
+
+// fixed size block allocator - items are carved from large slabs so same type objects sit next to each other,
+// freed items are recycled through an intrusive free list and the whole pool is released (or recycled) in one reset
+
+const static unsigned int csg_uiPoolItemAlignment = 16;
+const static unsigned int csg_uiPoolDefaultSlabSize = 65536; // bytes
+
+typedef struct _raaPoolSlab
+{
+	_raaPoolSlab *m_pNext;
+} raaPoolSlab;
+
+typedef struct _raaPool
+{
+	unsigned int m_uiItemSize;
+	unsigned int m_uiItemsPerSlab;
+	unsigned int m_uiSlabUsed; // items carved from the current slab
+	unsigned int m_uiCount; // live items
+	raaPoolSlab *m_pSlabs; // current slab at the head
+	raaPoolSlab *m_pSpare; // slabs kept by a recycling reset
+	void *m_pFree;
+} raaPool;
+
+void poolInit(raaPool *pPool, unsigned int uiItemSize, unsigned int uiSlabSize=csg_uiPoolDefaultSlabSize);
+void* poolAlloc(raaPool *pPool);
+void poolFree(raaPool *pPool, void *pItem);
+void poolReset(raaPool *pPool, bool bKeepSlabs=false);
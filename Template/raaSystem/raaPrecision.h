@@ -0,0 +1,86 @@
+#pragma once
+#ifdef _DEBUG
+#pragma comment(lib,"raaSystemD")
+#else
+#pragma comment(lib,"raaSystemR")
+#endif
+
+// precision policies for the solver. Real holds the node state, Compute evaluates an arc force and Accumulator sums them.
+// add() puts a step onto a position, the compensated policy carries its rounding into the next step in afCarry[uiIndex].
+// With s_bShadow the state lives in solver owned double arrays and the float store is a rounded copy.
+
+template<class T> struct raaSumPlain
+{
+	T m_tSum;
+
+	inline void init(T tValue) { m_tSum = tValue; }
+	inline void add(T tValue) { m_tSum += tValue; }
+	inline T value() const { return m_tSum; }
+};
+
+// kahan summation, the carry holds the low order bits the running sum could not
+struct raaSumKahan
+{
+	float m_fSum;
+	float m_fCarry;
+
+	inline void init(float fValue) { m_fSum = fValue; m_fCarry = 0.0f; }
+	inline void add(float fValue)
+	{
+		float fCorrected = fValue - m_fCarry;
+		float fSum = m_fSum + fCorrected;
+		m_fCarry = (fSum - m_fSum) - fCorrected;
+		m_fSum = fSum;
+	}
+	inline float value() const { return m_fSum; }
+};
+
+// float throughout, the default and the only policy the simd kernels implement
+struct raaPrecisionFloat
+{
+	typedef float Real;
+	typedef float Compute;
+	typedef raaSumPlain<float> Accumulator;
+	static const bool s_bShadow = false;
+
+	static inline Real add(Real tBase, Real tStep, float*, unsigned int) { return tBase + tStep; }
+};
+
+// float storage, arc forces evaluated and summed in double
+struct raaPrecisionMixed
+{
+	typedef float Real;
+	typedef double Compute;
+	typedef raaSumPlain<double> Accumulator;
+	static const bool s_bShadow = false;
+
+	static inline Real add(Real tBase, Real tStep, float*, unsigned int) { return tBase + tStep; }
+};
+
+// float storage, kahan summed forces and position updates carried per component
+struct raaPrecisionCompensated
+{
+	typedef float Real;
+	typedef float Compute;
+	typedef raaSumKahan Accumulator;
+	static const bool s_bShadow = false;
+
+	static inline Real add(Real tBase, Real tStep, float *afCarry, unsigned int uiIndex)
+	{
+		float fCorrected = tStep - afCarry[uiIndex];
+		float fSum = tBase + fCorrected;
+		afCarry[uiIndex] = (fSum - tBase) - fCorrected;
+		return fSum;
+	}
+};
+
+// double state, forces and integration
+struct raaPrecisionDouble
+{
+	typedef double Real;
+	typedef double Compute;
+	typedef raaSumPlain<double> Accumulator;
+	static const bool s_bShadow = true;
+
+	static inline Real add(Real tBase, Real tStep, float*, unsigned int) { return tBase + tStep; }
+};
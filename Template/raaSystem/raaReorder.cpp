@@ -0,0 +1,213 @@
+#include "stdafx.h"
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "raaReorder.h"
+
+static unsigned int reorderMortonSpread(unsigned int ui)
+{
+	// spread the low 10 bits so there are 2 zero bits between each
+	ui &= 0x3ff;
+	ui = (ui | (ui << 16)) & 0x030000ff;
+	ui = (ui | (ui << 8)) & 0x0300f00f;
+	ui = (ui | (ui << 4)) & 0x030c30c3;
+	ui = (ui | (ui << 2)) & 0x09249249;
+	return ui;
+}
+
+static unsigned int reorderMortonKey(const unsigned int *auiCoord)
+{
+	return reorderMortonSpread(auiCoord[0]) | (reorderMortonSpread(auiCoord[1]) << 1) | (reorderMortonSpread(auiCoord[2]) << 2);
+}
+
+static unsigned int reorderHilbertKey(const unsigned int *auiCoord)
+{
+	// skilling's axes to transposed hilbert index, then interleave the transpose into a single key
+	unsigned int auiX[3] = { auiCoord[0], auiCoord[1], auiCoord[2] };
+	unsigned int uiM = 1 << (csg_uiReorderCurveBits - 1);
+
+	for (unsigned int uiQ = uiM; uiQ > 1; uiQ >>= 1)
+	{
+		unsigned int uiP = uiQ - 1;
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			if (auiX[i] & uiQ) auiX[0] ^= uiP;
+			else
+			{
+				unsigned int uiT = (auiX[0] ^ auiX[i]) & uiP;
+				auiX[0] ^= uiT;
+				auiX[i] ^= uiT;
+			}
+		}
+	}
+
+	auiX[1] ^= auiX[0];
+	auiX[2] ^= auiX[1];
+
+	unsigned int uiT = 0;
+	for (unsigned int uiQ = uiM; uiQ > 1; uiQ >>= 1) if (auiX[2] & uiQ) uiT ^= uiQ - 1;
+	for (unsigned int i = 0; i < 3; i++) auiX[i] ^= uiT;
+
+	return (reorderMortonSpread(auiX[2])) | (reorderMortonSpread(auiX[1]) << 1) | (reorderMortonSpread(auiX[0]) << 2);
+}
+
+static void reorderByCurve(raaSystem *pSystem, unsigned int uiMethod, unsigned int *auiOrder)
+{
+	raaNodeStore *pStore = &(pSystem->m_Nodes);
+	float afMin[3] = { 0.0f, 0.0f, 0.0f }, afMax[3] = { 0.0f, 0.0f, 0.0f };
+
+	for (unsigned int i = 0; i < pStore->m_uiCount; i++)
+	{
+		float *pfPos = pStore->m_afPosition + i * 4;
+		for (unsigned int j = 0; j < 3; j++)
+		{
+			if (!i || pfPos[j] < afMin[j]) afMin[j] = pfPos[j];
+			if (!i || pfPos[j] > afMax[j]) afMax[j] = pfPos[j];
+		}
+	}
+
+	float fRange = std::max(afMax[0] - afMin[0], std::max(afMax[1] - afMin[1], afMax[2] - afMin[2]));
+	float fScale = fRange > 0.0f ? ((float)((1 << csg_uiReorderCurveBits) - 1)) / fRange : 0.0f;
+
+	std::vector<std::pair<unsigned int, unsigned int> > vKeys(pStore->m_uiCount);
+	for (unsigned int i = 0; i < pStore->m_uiCount; i++)
+	{
+		float *pfPos = pStore->m_afPosition + i * 4;
+		unsigned int auiCoord[3];
+		for (unsigned int j = 0; j < 3; j++) auiCoord[j] = (unsigned int)((pfPos[j] - afMin[j])*fScale);
+
+		vKeys[i].first = uiMethod == csg_uiReorderHilbert ? reorderHilbertKey(auiCoord) : reorderMortonKey(auiCoord);
+		vKeys[i].second = i;
+	}
+
+	std::sort(vKeys.begin(), vKeys.end());
+	for (unsigned int i = 0; i < pStore->m_uiCount; i++) auiOrder[i] = vKeys[i].second;
+}
+
+static void reorderByRCM(raaSystem *pSystem, unsigned int *auiOrder)
+{
+	raaTopology *pTopology = &(pSystem->m_Topology);
+	unsigned int uiNodes = pTopology->m_uiNodeCount;
+	std::vector<bool> vVisited(uiNodes, false);
+	std::vector<unsigned int> vByDegree(uiNodes);
+	std::vector<unsigned int> vNeighbours;
+	unsigned int uiOut = 0;
+
+	// components are started from their lowest degree node (a cheap pseudo-peripheral choice)
+	for (unsigned int i = 0; i < uiNodes; i++) vByDegree[i] = i;
+	std::stable_sort(vByDegree.begin(), vByDegree.end(), [pSystem](unsigned int ui0, unsigned int ui1) { return nodeDegree(pSystem, ui0) < nodeDegree(pSystem, ui1); });
+
+	for (unsigned int s = 0; s < uiNodes; s++)
+	{
+		if (vVisited[vByDegree[s]]) continue;
+
+		// breadth first, auiOrder doubles as the queue
+		unsigned int uiHead = uiOut;
+		auiOrder[uiOut++] = vByDegree[s];
+		vVisited[vByDegree[s]] = true;
+
+		while (uiHead < uiOut)
+		{
+			unsigned int uiNode = auiOrder[uiHead++];
+			unsigned int uiCount;
+			const unsigned int *auiNeighbour = nodeNeighbours(pSystem, uiNode, uiCount);
+
+			vNeighbours.clear();
+			for (unsigned int i = 0; i < uiCount; i++) if (!vVisited[auiNeighbour[i]])
+			{
+				vVisited[auiNeighbour[i]] = true;
+				vNeighbours.push_back(auiNeighbour[i]);
+			}
+
+			std::stable_sort(vNeighbours.begin(), vNeighbours.end(), [pSystem](unsigned int ui0, unsigned int ui1) { return nodeDegree(pSystem, ui0) < nodeDegree(pSystem, ui1); });
+			for (unsigned int i = 0; i < vNeighbours.size(); i++) auiOrder[uiOut++] = vNeighbours[i];
+		}
+	}
+
+	std::reverse(auiOrder, auiOrder + uiNodes);
+}
+
+static void reorderPermute(float *pfData, const unsigned int *auiOrder, unsigned int uiCount, unsigned int uiWidth)
+{
+	float *pfTemp = (float*)systemAlignedAlloc(sizeof(float)*uiCount*uiWidth);
+	for (unsigned int i = 0; i < uiCount; i++) memcpy(pfTemp + i * uiWidth, pfData + auiOrder[i] * uiWidth, sizeof(float)*uiWidth);
+	memcpy(pfData, pfTemp, sizeof(float)*uiCount*uiWidth);
+	systemAlignedFree(pfTemp);
+}
+
+void reorderNodes(raaSystem* pSystem, const unsigned int* auiOrder)
+{
+	if (pSystem && auiOrder)
+	{
+		raaNodeStore *pStore = &(pSystem->m_Nodes);
+
+		reorderPermute(pStore->m_afPosition, auiOrder, pStore->m_uiCount, 4);
+		reorderPermute(pStore->m_afVelocity, auiOrder, pStore->m_uiCount, 4);
+		reorderPermute(pStore->m_afForce, auiOrder, pStore->m_uiCount, 4);
+		reorderPermute(pStore->m_afInvMass, auiOrder, pStore->m_uiCount, 1);
+
+		std::vector<raaNode*> vNodes(pStore->m_apNode, pStore->m_apNode + pStore->m_uiCount);
+		for (unsigned int i = 0; i < pStore->m_uiCount; i++)
+		{
+			pStore->m_apNode[i] = vNodes[auiOrder[i]];
+			pStore->m_apNode[i]->m_uiIndex = i;
+		}
+
+		// keep the compatibility list in dense order
+		if (pSystem->m_bNodeList)
+		{
+			std::vector<raaLinkedListElement*> vElements;
+			for (raaLinkedListElement *pE = pSystem->m_llNodes.m_pHead; pE; pE = pE->m_pNext) vElements.push_back(pE);
+			std::sort(vElements.begin(), vElements.end(), [](raaLinkedListElement *p0, raaLinkedListElement *p1) { return ((raaNode*)p0->m_pData)->m_uiIndex < ((raaNode*)p1->m_pData)->m_uiIndex; });
+
+			clearList(&(pSystem->m_llNodes));
+			for (unsigned int i = 0; i < vElements.size(); i++) pushTail(&(pSystem->m_llNodes), initElement(vElements[i], vElements[i]->m_pData, csg_uiNode));
+		}
+
+		pSystem->m_Topology.m_bValid = false;
+	}
+}
+
+void reorderArcs(raaSystem* pSystem)
+{
+	if (pSystem)
+	{
+		std::vector<raaLinkedListElement*> vElements;
+		for (raaLinkedListElement *pE = pSystem->m_llArcs.m_pHead; pE; pE = pE->m_pNext) if (pE->m_pData) vElements.push_back(pE);
+
+		// sort by lower then higher end node so consecutive arcs touch neighbouring memory
+		std::stable_sort(vElements.begin(), vElements.end(), [](raaLinkedListElement *p0, raaLinkedListElement *p1)
+		{
+			raaArc *pA0 = (raaArc*)p0->m_pData, *pA1 = (raaArc*)p1->m_pData;
+			unsigned int uiLo0 = std::min(pA0->m_pNode0->m_uiIndex, pA0->m_pNode1->m_uiIndex), uiHi0 = std::max(pA0->m_pNode0->m_uiIndex, pA0->m_pNode1->m_uiIndex);
+			unsigned int uiLo1 = std::min(pA1->m_pNode0->m_uiIndex, pA1->m_pNode1->m_uiIndex), uiHi1 = std::max(pA1->m_pNode0->m_uiIndex, pA1->m_pNode1->m_uiIndex);
+			return uiLo0 < uiLo1 || (uiLo0 == uiLo1 && uiHi0 < uiHi1);
+		});
+
+		clearList(&(pSystem->m_llArcs));
+		for (unsigned int i = 0; i < vElements.size(); i++) pushTail(&(pSystem->m_llArcs), initElement(vElements[i], vElements[i]->m_pData, csg_uiArc));
+
+		pSystem->m_Topology.m_bValid = false;
+	}
+}
+
+void reorderSystem(raaSystem* pSystem, unsigned int uiMethod)
+{
+	if (pSystem && pSystem->m_Nodes.m_uiCount)
+	{
+		unsigned int *auiOrder = new unsigned int[pSystem->m_Nodes.m_uiCount];
+
+		if (uiMethod == csg_uiReorderRCM)
+		{
+			if (!pSystem->m_Topology.m_bValid || !pSystem->m_Topology.m_bAdjacencyValid) buildTopology(pSystem);
+			reorderByRCM(pSystem, auiOrder);
+		}
+		else reorderByCurve(pSystem, uiMethod, auiOrder);
+
+		reorderNodes(pSystem, auiOrder);
+		reorderArcs(pSystem);
+		buildTopology(pSystem);
+
+		delete[] auiOrder;
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+#ifdef _DEBUG
+#pragma comment(lib,"raaSystemD")
+#else
+#pragma comment(lib,"raaSystemR")
+#endif
+
+#include "raaSystem.h"
+
+// post load renumbering of the dense node indices for cache locality. Node ids (m_uiId) are untouched so nodeById and
+// any export keyed by id are unaffected. Arcs are sorted by their (renumbered) end nodes and the topology is rebuilt.
+const static unsigned int csg_uiReorderRCM = 1; // reverse cuthill-mckee over the arc structure
+const static unsigned int csg_uiReorderHilbert = 2; // 3D hilbert curve over the current node positions
+const static unsigned int csg_uiReorderMorton = 3; // 3D morton (z-order) curve over the current node positions
+
+const static unsigned int csg_uiReorderCurveBits = 10; // per axis quantisation for the space filling curves
+
+void reorderSystem(raaSystem *pSystem, unsigned int uiMethod);
+void reorderNodes(raaSystem *pSystem, const unsigned int *auiOrder); // auiOrder[new index] = old index
+void reorderArcs(raaSystem *pSystem);
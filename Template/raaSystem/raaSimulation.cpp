@@ -0,0 +1,158 @@
+#include "stdafx.h"
+#include <string.h>
+#include <chrono>
+#include "raaSimulation.h"
+
+static void simulationPublish(raaSimulation *pSimulation)
+{
+	raaNodeStore *pStore = &(pSimulation->m_pSystem->m_Nodes);
+	unsigned int uiFloats = pStore->m_uiCount * 4 < pSimulation->m_Positions.m_uiFloats ? pStore->m_uiCount * 4 : pSimulation->m_Positions.m_uiFloats;
+
+	memcpy(tripleBufferWrite(&(pSimulation->m_Positions)), pStore->m_afPosition, sizeof(float) * uiFloats);
+	tripleBufferPublish(&(pSimulation->m_Positions));
+}
+
+// steps until the frame budget would be overrun or the solver converges, at least one step
+static void simulationFrame(raaSimulation *pSimulation)
+{
+	typedef std::chrono::steady_clock raaClock;
+	raaClock::time_point tFrame = raaClock::now(), tStep = tFrame;
+	unsigned int uiSteps = 0;
+
+	do
+	{
+		solverStep(pSimulation->m_pSolver, pSimulation->m_pSystem);
+		uiSteps++;
+
+		raaClock::time_point tNow = raaClock::now();
+		float fStep = std::chrono::duration<float, std::milli>(tNow - tStep).count();
+		pSimulation->m_fStepTime = pSimulation->m_fStepTime > 0.0f ? pSimulation->m_fStepTime + (fStep - pSimulation->m_fStepTime) * csg_fSimulationStepTimeWeight : fStep;
+		tStep = tNow;
+	} while (!solverConverged(pSimulation->m_pSolver) && std::chrono::duration<float, std::milli>(tStep - tFrame).count() + pSimulation->m_fStepTime <= pSimulation->m_fFrameBudget);
+
+	pSimulation->m_uiSteps += uiSteps;
+	pSimulation->m_uiFrameSteps = uiSteps;
+}
+
+static void simulationThread(raaSimulation *pSimulation)
+{
+	std::vector<std::function<void()>> vCommands;
+
+	while (true)
+	{
+		bool bRunning, bQuit;
+		{
+			std::unique_lock<std::mutex> lock(pSimulation->m_Mutex);
+			auto fReady = [pSimulation] { return pSimulation->m_bQuit || !pSimulation->m_vCommands.empty(); };
+
+			// stopped, wait for something to do. Converged, only probe now and then unless a command comes in
+			if (!pSimulation->m_bRunning) pSimulation->m_cvWake.wait(lock, [pSimulation, &fReady] { return fReady() || pSimulation->m_bRunning; });
+			else if (pSimulation->m_bConverged) pSimulation->m_cvWake.wait_for(lock, std::chrono::milliseconds(pSimulation->m_uiRestSleep), [pSimulation, &fReady] { return fReady() || !pSimulation->m_bRunning; });
+
+			vCommands.swap(pSimulation->m_vCommands);
+			bRunning = pSimulation->m_bRunning;
+			bQuit = pSimulation->m_bQuit;
+		}
+
+		for (unsigned int i = 0; i < vCommands.size(); i++) vCommands[i]();
+		if (bQuit) break;
+
+		if (bRunning) simulationFrame(pSimulation);
+		pSimulation->m_bConverged = solverConverged(pSimulation->m_pSolver);
+
+		if (bRunning || !vCommands.empty()) simulationPublish(pSimulation);
+		vCommands.clear();
+	}
+}
+
+void simulationInit(raaSimulation *pSimulation, raaSystem *pSystem, raaSolver *pSolver)
+{
+	if (pSimulation && pSystem && pSolver)
+	{
+		pSimulation->m_pSystem = pSystem;
+		pSimulation->m_pSolver = pSolver;
+		pSimulation->m_bRunning = false;
+		pSimulation->m_bQuit = false;
+		pSimulation->m_bConverged = false;
+		pSimulation->m_uiSteps = 0;
+		pSimulation->m_uiRestSleep = csg_uiSimulationDefaultRestSleep;
+		pSimulation->m_fFrameBudget = csg_fSimulationDefaultFrameBudget;
+		pSimulation->m_fStepTime = 0.0f;
+		pSimulation->m_uiFrameSteps = 0;
+		pSimulation->m_vCommands.clear();
+
+		tripleBufferInit(&(pSimulation->m_Positions), pSystem->m_Nodes.m_uiCount * 4);
+		simulationPublish(pSimulation);
+
+		pSimulation->m_Thread = std::thread(simulationThread, pSimulation);
+	}
+}
+
+void simulationDestroy(raaSimulation *pSimulation)
+{
+	if (pSimulation && pSimulation->m_Thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(pSimulation->m_Mutex);
+			pSimulation->m_bQuit = true;
+		}
+		pSimulation->m_cvWake.notify_one();
+		pSimulation->m_Thread.join();
+
+		tripleBufferDestroy(&(pSimulation->m_Positions));
+		pSimulation->m_pSystem = 0;
+		pSimulation->m_pSolver = 0;
+	}
+}
+
+void simulationSetRunning(raaSimulation *pSimulation, bool bRunning)
+{
+	if (pSimulation)
+	{
+		{
+			std::lock_guard<std::mutex> lock(pSimulation->m_Mutex);
+			pSimulation->m_bRunning = bRunning;
+		}
+		pSimulation->m_cvWake.notify_one();
+	}
+}
+
+bool simulationRunning(raaSimulation *pSimulation)
+{
+	if (!pSimulation) return false;
+
+	std::lock_guard<std::mutex> lock(pSimulation->m_Mutex);
+	return pSimulation->m_bRunning;
+}
+
+bool simulationConverged(raaSimulation *pSimulation)
+{
+	return pSimulation ? pSimulation->m_bConverged.load() : false;
+}
+
+void simulationSetFrameBudget(raaSimulation *pSimulation, float fMilliseconds)
+{
+	if (pSimulation) simulationPost(pSimulation, [pSimulation, fMilliseconds]() { pSimulation->m_fFrameBudget = fMilliseconds > 0.0f ? fMilliseconds : 0.0f; });
+}
+
+void simulationPost(raaSimulation *pSimulation, std::function<void()> fCommand)
+{
+	if (pSimulation && fCommand)
+	{
+		{
+			std::lock_guard<std::mutex> lock(pSimulation->m_Mutex);
+			pSimulation->m_vCommands.push_back(fCommand);
+		}
+		pSimulation->m_cvWake.notify_one();
+	}
+}
+
+const float* simulationPositions(raaSimulation *pSimulation)
+{
+	return pSimulation ? tripleBufferRead(&(pSimulation->m_Positions)) : 0;
+}
+
+unsigned int simulationNodes(raaSimulation *pSimulation)
+{
+	return pSimulation ? pSimulation->m_Positions.m_uiFloats / 4 : 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#ifdef _DEBUG
+#pragma comment(lib,"raaSystemD")
+#else
+#pragma comment(lib,"raaSystemR")
+#endif
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "raaSystem.h"
+#include "raaSolver.h"
+#include "raaTripleBuffer.h"
+
+// the solver on a thread of its own. While running the thread steps the solver in frames of m_fFrameBudget ms and publishes
+// the node positions after each frame through a triple buffer the renderer reads without waiting, so a slow step never
+// holds up a frame. A frame runs as many steps as fit its budget, measured with the steady clock - a step is started only
+// if the running mean step time says it will end inside the budget, so the step count follows the machine and the graph
+// from frame to frame, and at least one step runs. Once the solver has converged the thread waits m_uiRestSleep ms between
+// steps. The thread owns the system positions and the solver - anything else that changes them (settings, layouts, moving
+// nodes) is posted as a command, run by the thread between frames in the order posted, so a command waits at most one
+// frame. Only the node positions change while the thread runs, the node and arc records may be read from any thread.
+
+const static unsigned int csg_uiSimulationDefaultRestSleep = 15; // ms
+const static float csg_fSimulationDefaultFrameBudget = 16.0f; // ms, about one display refresh
+const static float csg_fSimulationStepTimeWeight = 0.1f; // of the latest step in the running mean step time
+
+typedef struct _raaSimulation
+{
+	raaSystem *m_pSystem;
+	raaSolver *m_pSolver;
+	raaTripleBuffer m_Positions; // 4 floats per node in node store order
+	std::thread m_Thread;
+	std::mutex m_Mutex; // guards the commands and flags below
+	std::condition_variable m_cvWake;
+	std::vector<std::function<void()>> m_vCommands;
+	bool m_bRunning;
+	bool m_bQuit;
+	std::atomic<bool> m_bConverged; // as of the last step
+	std::atomic<unsigned int> m_uiSteps; // steps taken since init
+	unsigned int m_uiRestSleep;
+	float m_fFrameBudget; // ms of stepping per publish, 0 publishes after every step. Simulation thread only
+	float m_fStepTime; // running mean ms per step
+	std::atomic<unsigned int> m_uiFrameSteps; // steps in the last frame
+} raaSimulation;
+
+// starts the thread, not running, and publishes the current positions. The system must hold all its nodes by now
+void simulationInit(raaSimulation *pSimulation, raaSystem *pSystem, raaSolver *pSolver);
+void simulationDestroy(raaSimulation *pSimulation); // runs the outstanding commands then stops the thread
+
+void simulationSetRunning(raaSimulation *pSimulation, bool bRunning);
+bool simulationRunning(raaSimulation *pSimulation);
+bool simulationConverged(raaSimulation *pSimulation);
+void simulationSetFrameBudget(raaSimulation *pSimulation, float fMilliseconds); // posted, applies from the next frame
+
+// fCommand() is called on the simulation thread before its next step, the positions are published after it
+void simulationPost(raaSimulation *pSimulation, std::function<void()> fCommand);
+
+// latest published positions, node store index i at [i * 4], valid until the next call. Consumer side, one thread only
+const float* simulationPositions(raaSimulation *pSimulation);
+unsigned int simulationNodes(raaSimulation *pSimulation); // nodes in a published array
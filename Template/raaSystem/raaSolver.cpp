@@ -0,0 +1,1067 @@
+#include "stdafx.h"
+#include <math.h>
+#include <string.h>
+#include <raaMaths/raaMaths.h>
+#include "raaSolver.h"
+
+static void solverReserve(raaSolver *pSolver, unsigned int uiThreads, unsigned int uiNodes)
+{
+	unsigned int uiLine = csg_uiSystemAlignment / sizeof(float);
+	unsigned int uiStride = (uiNodes * 4 + uiLine - 1) / uiLine * uiLine;
+
+	if (uiThreads != pSolver->m_uiThreadBuffers || uiStride > pSolver->m_uiThreadStride)
+	{
+		systemAlignedFree(pSolver->m_afThreadForce);
+		pSolver->m_afThreadForce = (float*)systemAlignedAlloc(sizeof(float)*uiThreads*uiStride);
+		memset(pSolver->m_afThreadForce, 0, sizeof(float)*uiThreads*uiStride);
+		pSolver->m_uiThreadBuffers = uiThreads;
+		pSolver->m_uiThreadStride = uiStride;
+	}
+}
+
+static void solverReserveStats(raaSolver *pSolver, unsigned int uiSlots)
+{
+	if (uiSlots > pSolver->m_uiStatCapacity)
+	{
+		systemAlignedFree(pSolver->m_afThreadStats);
+		pSolver->m_afThreadStats = (float*)systemAlignedAlloc(csg_uiSystemAlignment * uiSlots);
+		pSolver->m_uiStatCapacity = uiSlots;
+	}
+	pSolver->m_uiStatSlots = uiSlots;
+}
+
+static void solverReserveStage(raaSolver *pSolver, unsigned int uiBytes)
+{
+	if (uiBytes > pSolver->m_uiStageBytes)
+	{
+		systemAlignedFree(pSolver->m_pStage);
+		pSolver->m_pStage = systemAlignedAlloc(uiBytes);
+		pSolver->m_uiStageBytes = uiBytes;
+	}
+}
+
+// shadow state for the double and compensated precisions. A new node count reloads everything, otherwise double reloads
+// any node the step will read whose store position or velocity no longer matches its rounded shadow, ie was set from outside
+static void solverReserveShadow(raaSolver *pSolver, raaNodeStore *pStore, bool bSleep)
+{
+	unsigned int uiNodes = pStore->m_uiCount;
+	bool bDouble = pSolver->m_uiPrecision == csg_uiSolverPrecisionDouble;
+
+	if (uiNodes > pSolver->m_uiShadowCapacity)
+	{
+		systemAlignedFree(pSolver->m_adShadow);
+		systemAlignedFree(pSolver->m_afCarry);
+		pSolver->m_adShadow = (double*)systemAlignedAlloc(sizeof(double) * 12 * uiNodes);
+		pSolver->m_afCarry = (float*)systemAlignedAlloc(sizeof(float) * 4 * uiNodes);
+		pSolver->m_uiShadowCapacity = uiNodes;
+		pSolver->m_uiShadowNodes = 0;
+	}
+
+	double *adPosition = pSolver->m_adShadow, *adVelocity = adPosition + 4 * pSolver->m_uiShadowCapacity;
+	const float *afPosition = pStore->m_afPosition, *afVelocity = pStore->m_afVelocity;
+
+	if (uiNodes != pSolver->m_uiShadowNodes)
+	{
+		memset(pSolver->m_afCarry, 0, sizeof(float) * 4 * uiNodes);
+		if (bDouble) for (unsigned int i = 0; i < uiNodes * 4; i++)
+		{
+			adPosition[i] = afPosition[i];
+			adVelocity[i] = afVelocity[i];
+		}
+		pSolver->m_uiShadowNodes = uiNodes;
+		return;
+	}
+
+	if (bDouble)
+	{
+		unsigned int uiCount = bSleep ? pSolver->m_uiActive : uiNodes;
+		for (unsigned int k = 0; k < uiCount; k++)
+		{
+			unsigned int i = (bSleep ? pSolver->m_auiActive[k] : k) * 4;
+			if ((float)adPosition[i] != afPosition[i] || (float)adPosition[i + 1] != afPosition[i + 1] || (float)adPosition[i + 2] != afPosition[i + 2])
+				for (int j = 0; j < 4; j++) adPosition[i + j] = afPosition[i + j];
+			if ((float)adVelocity[i] != afVelocity[i] || (float)adVelocity[i + 1] != afVelocity[i + 1] || (float)adVelocity[i + 2] != afVelocity[i + 2])
+				for (int j = 0; j < 4; j++) adVelocity[i + j] = afVelocity[i + j];
+		}
+	}
+}
+
+// the arrays a precision integrates, the store itself for float storage and the shadow for double
+static inline void solverStateArrays(raaSolver *, raaNodeStore *pStore, float *&afPosition, float *&afVelocity, float *&afForce)
+{
+	afPosition = pStore->m_afPosition;
+	afVelocity = pStore->m_afVelocity;
+	afForce = pStore->m_afForce;
+}
+
+static inline void solverStateArrays(raaSolver *pSolver, raaNodeStore *, double *&adPosition, double *&adVelocity, double *&adForce)
+{
+	adPosition = pSolver->m_adShadow;
+	adVelocity = adPosition + 4 * pSolver->m_uiShadowCapacity;
+	adForce = adVelocity + 4 * pSolver->m_uiShadowCapacity;
+}
+
+void solverInit(raaSolver* pSolver, bool bParallel, raaThreadPool* pPool)
+{
+	if (pSolver)
+	{
+		memset(pSolver, 0, sizeof(raaSolver));
+		pSolver->m_fTimeStep = csg_fSolverDefaultTimeStep;
+		pSolver->m_fDamping = csg_fSolverDefaultDamping;
+		pSolver->m_bParallel = bParallel;
+		pSolver->m_uiKernel = solverKernelSupported();
+		pSolver->m_pPool = pPool;
+		pSolver->m_uiRepulsion = csg_uiSolverRepulsionNone;
+		pSolver->m_fRepulsion = csg_fSolverDefaultRepulsion;
+		pSolver->m_fTheta = csg_fSolverDefaultTheta;
+		pSolver->m_fSoftening = csg_fSolverDefaultSoftening;
+		pSolver->m_fFMMTheta = csg_fFMMDefaultTheta;
+		pSolver->m_fCollisionStiffness = csg_fSolverDefaultCollisionStiffness;
+		pSolver->m_uiConstraintIterations = csg_uiConstraintDefaultIterations;
+		pSolver->m_uiIntegrator = csg_uiSolverIntegratorLegacy;
+		pSolver->m_fFriction = csg_fSolverDefaultFriction;
+		pSolver->m_fMaxDisplacement = csg_fSolverDefaultMaxDisplacement;
+		pSolver->m_bAutoStop = true;
+		pSolver->m_fRestDisplacement = csg_fSolverDefaultRestDisplacement;
+		pSolver->m_fRestEnergy = csg_fSolverDefaultRestEnergy;
+		pSolver->m_uiRestSteps = csg_uiSolverDefaultRestSteps;
+		pSolver->m_uiRestProbe = csg_uiSolverDefaultRestProbe;
+		pSolver->m_fSleepDisplacement = csg_fSolverDefaultSleepDisplacement;
+		pSolver->m_fSleepAcceleration = csg_fSolverDefaultSleepAcceleration;
+		pSolver->m_uiSleepSteps = csg_uiSolverDefaultSleepSteps;
+		pSolver->m_uiPrecision = RAA_SOLVER_DEFAULT_PRECISION;
+		octreeInit(&(pSolver->m_Octree));
+		fmmInit(&(pSolver->m_FMM));
+		gridInit(&(pSolver->m_Grid));
+		constraintInit(&(pSolver->m_Constraints));
+	}
+}
+
+void solverDestroy(raaSolver* pSolver)
+{
+	if (pSolver)
+	{
+		systemAlignedFree(pSolver->m_afThreadForce);
+		systemAlignedFree(pSolver->m_afThreadStats);
+		systemAlignedFree(pSolver->m_pStage);
+		pSolver->m_afThreadForce = pSolver->m_afThreadStats = 0;
+		pSolver->m_pStage = 0;
+		pSolver->m_uiThreadBuffers = pSolver->m_uiThreadStride = pSolver->m_uiStageBytes = 0;
+		pSolver->m_uiStatSlots = pSolver->m_uiStatCapacity = 0;
+
+		systemAlignedFree(pSolver->m_auiQuiet);
+		systemAlignedFree(pSolver->m_aucMark);
+		systemAlignedFree(pSolver->m_auiActive);
+		systemAlignedFree(pSolver->m_ActiveArcs.m_auiArcNode0);
+		systemAlignedFree(pSolver->m_ActiveArcs.m_auiArcNode1);
+		systemAlignedFree(pSolver->m_ActiveArcs.m_afArcSpringCoef);
+		systemAlignedFree(pSolver->m_ActiveArcs.m_afArcIdealLen);
+		memset(&(pSolver->m_ActiveArcs), 0, sizeof(raaTopology));
+		pSolver->m_auiQuiet = pSolver->m_auiActive = 0;
+		pSolver->m_aucMark = 0;
+		pSolver->m_uiSleepCapacity = pSolver->m_uiAwake = pSolver->m_uiBoundary = pSolver->m_uiActive = 0;
+		pSolver->m_bActiveValid = false;
+
+		systemAlignedFree(pSolver->m_adShadow);
+		systemAlignedFree(pSolver->m_afCarry);
+		pSolver->m_adShadow = 0;
+		pSolver->m_afCarry = 0;
+		pSolver->m_uiShadowCapacity = pSolver->m_uiShadowNodes = 0;
+
+		systemAlignedFree(pSolver->m_afRadius);
+		pSolver->m_afRadius = 0;
+		pSolver->m_uiRadiusCapacity = pSolver->m_uiRadiusNodes = 0;
+
+		octreeDestroy(&(pSolver->m_Octree));
+		fmmDestroy(&(pSolver->m_FMM));
+		gridDestroy(&(pSolver->m_Grid));
+		constraintDestroy(&(pSolver->m_Constraints));
+		pSolver->m_bColoured = false;
+	}
+}
+
+void solverArcForceScalar(const raaTopology* pTopology, const float* afPosition, float* afForce, unsigned int uiBegin, unsigned int uiEnd)
+{
+	for (unsigned int uiArc = uiBegin; uiArc < uiEnd; uiArc++)
+	{
+		unsigned int uiNode0 = pTopology->m_auiArcNode0[uiArc] * 4;
+		unsigned int uiNode1 = pTopology->m_auiArcNode1[uiArc] * 4;
+
+		// vector between the 2 nodes and its length
+		float afDelta[3];
+		for (int i = 0; i < 3; i++) afDelta[i] = afPosition[uiNode1 + i] - afPosition[uiNode0 + i];
+		float fDistance = sqrtf(afDelta[0] * afDelta[0] + afDelta[1] * afDelta[1] + afDelta[2] * afDelta[2]);
+
+		if (fDistance > 0.0f)
+		{
+			// spring force = unit vector * extension * spring coefficient, equal and opposite on the 2 nodes
+			float fScale = (fDistance - pTopology->m_afArcIdealLen[uiArc]) * pTopology->m_afArcSpringCoef[uiArc] / fDistance;
+			for (int i = 0; i < 3; i++)
+			{
+				afForce[uiNode0 + i] += afDelta[i] * fScale;
+				afForce[uiNode1 + i] -= afDelta[i] * fScale;
+			}
+		}
+	}
+}
+
+void solverIntegrateScalar(const raaSolver* pSolver, raaNodeStore* pStore, unsigned int uiBegin, unsigned int uiEnd)
+{
+	for (unsigned int uiNode = uiBegin; uiNode < uiEnd; uiNode++)
+	{
+		float *pfPosition = pStore->m_afPosition + uiNode * 4;
+		float *pfVelocity = pStore->m_afVelocity + uiNode * 4;
+		float *pfForce = pStore->m_afForce + uiNode * 4;
+		float fInvMass = pStore->m_afInvMass[uiNode];
+
+		for (int i = 0; i < 3; i++)
+		{
+			pfVelocity[i] = (pfVelocity[i] + pfForce[i] * fInvMass) * pSolver->m_fTimeStep * (1.0f - pSolver->m_fDamping);
+			pfPosition[i] += pfVelocity[i] / pSolver->m_fTimeStep;
+		}
+	}
+}
+
+// overwrites the store force with the repulsion. Reads every position so has to finish before any node moves, each thread
+// writes only the nodes it is given
+static void solverRepulsion(raaSolver *pSolver, raaNodeStore *pStore, raaThreadPool *pPool)
+{
+	raaOctree *pTree = &(pSolver->m_Octree);
+
+	pTree->m_uiLeafSize = pSolver->m_uiRepulsion == csg_uiSolverRepulsionFMM ? csg_uiFMMLeafSize : csg_uiOctreeDefaultLeafSize;
+	octreeBuild(pTree, pStore->m_afPosition, pStore->m_uiCount);
+
+	if (pSolver->m_uiRepulsion == csg_uiSolverRepulsionFMM)
+	{
+		pSolver->m_FMM.m_uiGrain = pSolver->m_bDeterministic ? csg_uiFMMFixedGrain : 0;
+		memset(pStore->m_afForce, 0, sizeof(float) * 4 * pStore->m_uiCount);
+		fmmRepulsion(&(pSolver->m_FMM), pTree, pStore->m_afPosition, pStore->m_afForce, pSolver->m_fRepulsion, pSolver->m_fSoftening, pSolver->m_fFMMTheta, pPool);
+		return;
+	}
+
+	auto fBarnesHut = [pSolver, pStore, pTree](unsigned int uiBegin, unsigned int uiEnd, unsigned int)
+	{
+		for (unsigned int i = uiBegin; i < uiEnd; i++)
+		{
+			float *pfForce = pStore->m_afForce + i * 4;
+			pfForce[0] = pfForce[1] = pfForce[2] = 0.0f;
+			octreeRepulsion(pTree, pStore->m_afPosition, i, pSolver->m_fTheta, pSolver->m_fRepulsion, pSolver->m_fSoftening, pfForce);
+		}
+	};
+
+	if (pPool) threadPoolFor(pPool, pStore->m_uiCount, csg_uiSolverNodeChunk, fBarnesHut);
+	else fBarnesHut(0, pStore->m_uiCount, 0);
+}
+
+// adds the overlap force to the store force. Radii are the sphere radius of the node mass as volume, the size the viewer
+// draws
+static void solverCollision(raaSolver *pSolver, raaNodeStore *pStore, raaThreadPool *pPool)
+{
+	unsigned int uiNodes = pStore->m_uiCount;
+
+	if (uiNodes != pSolver->m_uiRadiusNodes)
+	{
+		if (uiNodes > pSolver->m_uiRadiusCapacity)
+		{
+			systemAlignedFree(pSolver->m_afRadius);
+			pSolver->m_afRadius = (float*)systemAlignedAlloc(sizeof(float) * uiNodes);
+			pSolver->m_uiRadiusCapacity = uiNodes;
+		}
+
+		pSolver->m_fMaxRadius = 0.0f;
+		for (unsigned int i = 0; i < uiNodes; i++)
+		{
+			float fMass = pStore->m_apNode[i]->m_fMass;
+			pSolver->m_afRadius[i] = fMass > 0.0f ? mathsRadiusOfSphereFromVolume(fMass) : 0.0f;
+			if (pSolver->m_afRadius[i] > pSolver->m_fMaxRadius) pSolver->m_fMaxRadius = pSolver->m_afRadius[i];
+		}
+		pSolver->m_uiRadiusNodes = uiNodes;
+	}
+
+	if (pSolver->m_fMaxRadius <= 0.0f) return;
+
+	gridBuild(&(pSolver->m_Grid), pStore->m_afPosition, uiNodes, 2.0f * pSolver->m_fMaxRadius, pPool);
+	gridCollision(&(pSolver->m_Grid), pStore->m_afPosition, pSolver->m_afRadius, pSolver->m_fMaxRadius, pSolver->m_fCollisionStiffness, pStore->m_afForce, pPool);
+}
+
+// forces between nodes rather than along arcs, the repulsion and the collision
+static inline bool solverNodeForcesOn(const raaSolver *pSolver)
+{
+	return pSolver->m_uiRepulsion != csg_uiSolverRepulsionNone || pSolver->m_bCollision;
+}
+
+// overwrites the store force with the forces between nodes, before any node moves
+static void solverNodeForces(raaSolver *pSolver, raaNodeStore *pStore, raaThreadPool *pPool)
+{
+	if (pSolver->m_uiRepulsion != csg_uiSolverRepulsionNone) solverRepulsion(pSolver, pStore, pPool);
+	else memset(pStore->m_afForce, 0, sizeof(float) * 4 * pStore->m_uiCount);
+
+	if (pSolver->m_bCollision) solverCollision(pSolver, pStore, pPool);
+}
+
+bool solverSetKernel(raaSolver* pSolver, unsigned int uiKernel)
+{
+	if (pSolver && uiKernel <= solverKernelSupported())
+	{
+		pSolver->m_uiKernel = uiKernel;
+		return true;
+	}
+	return false;
+}
+
+void solverSetTimeStep(raaSolver* pSolver, float fTimeStep)
+{
+	if (pSolver)
+	{
+		if (!(fTimeStep >= csg_fSolverMinTimeStep)) fTimeStep = csg_fSolverMinTimeStep;
+		if (fTimeStep > csg_fSolverMaxTimeStep) fTimeStep = csg_fSolverMaxTimeStep;
+		pSolver->m_fTimeStep = fTimeStep;
+	}
+}
+
+void solverSetIntegrator(raaSolver* pSolver, unsigned int uiIntegrator)
+{
+	if (pSolver && uiIntegrator < csg_uiSolverIntegrators)
+	{
+		pSolver->m_uiIntegrator = uiIntegrator;
+		solverWake(pSolver);
+	}
+}
+
+void solverSetPrecision(raaSolver* pSolver, unsigned int uiPrecision)
+{
+	if (pSolver && uiPrecision < csg_uiSolverPrecisions)
+	{
+		pSolver->m_uiPrecision = uiPrecision;
+		pSolver->m_uiShadowNodes = 0;
+		solverWake(pSolver);
+	}
+}
+
+bool solverConverged(const raaSolver* pSolver)
+{
+	return pSolver && pSolver->m_bAutoStop && pSolver->m_bConverged;
+}
+
+void solverWake(raaSolver* pSolver)
+{
+	if (pSolver)
+	{
+		pSolver->m_fStableStep = 0.0f;
+		pSolver->m_bPrimed = false;
+		pSolver->m_uiRadiusNodes = 0;
+		pSolver->m_bColoured = false;
+		pSolver->m_bConverged = false;
+		pSolver->m_uiQuietSteps = pSolver->m_uiProbeCount = 0;
+
+		if (pSolver->m_auiQuiet) memset(pSolver->m_auiQuiet, 0, sizeof(unsigned int) * pSolver->m_uiSleepNodes);
+		pSolver->m_bActiveValid = false;
+	}
+}
+
+void solverWakeNode(raaSolver* pSolver, unsigned int uiNode)
+{
+	if (pSolver)
+	{
+		pSolver->m_bConverged = false;
+		pSolver->m_uiQuietSteps = pSolver->m_uiProbeCount = 0;
+
+		if (pSolver->m_auiQuiet && uiNode < pSolver->m_uiSleepNodes && pSolver->m_auiQuiet[uiNode])
+		{
+			if (pSolver->m_auiQuiet[uiNode] >= pSolver->m_uiSleepSteps) pSolver->m_bActiveValid = false;
+			pSolver->m_auiQuiet[uiNode] = 0;
+		}
+	}
+}
+
+unsigned int solverAwakeNodes(const raaSolver* pSolver)
+{
+	return pSolver ? pSolver->m_uiAwake : 0;
+}
+
+template<class T> static T* solverGrowArray(T *aT, unsigned int uiCount, unsigned int uiCapacity)
+{
+	T *aNew = (T*)systemAlignedAlloc(sizeof(T) * uiCapacity);
+	if (aT) memcpy(aNew, aT, sizeof(T) * uiCount);
+	systemAlignedFree(aT);
+	return aNew;
+}
+
+// node state arrays match the store, a change in the node or arc set means indices may have moved so everything wakes
+static void solverSleepReserve(raaSolver *pSolver, raaSystem *pSystem)
+{
+	unsigned int uiNodes = pSystem->m_Nodes.m_uiCount;
+
+	if (uiNodes != pSolver->m_uiSleepNodes || pSystem->m_Topology.m_uiArcCount != pSolver->m_uiSleepArcs || !pSystem->m_Topology.m_bAdjacencyValid)
+	{
+		if (uiNodes > pSolver->m_uiSleepCapacity)
+		{
+			systemAlignedFree(pSolver->m_auiQuiet);
+			systemAlignedFree(pSolver->m_aucMark);
+			systemAlignedFree(pSolver->m_auiActive);
+			pSolver->m_auiQuiet = (unsigned int*)systemAlignedAlloc(sizeof(unsigned int) * uiNodes);
+			pSolver->m_aucMark = (unsigned char*)systemAlignedAlloc(uiNodes);
+			pSolver->m_auiActive = (unsigned int*)systemAlignedAlloc(sizeof(unsigned int) * uiNodes);
+			pSolver->m_uiSleepCapacity = uiNodes;
+		}
+
+		memset(pSolver->m_auiQuiet, 0, sizeof(unsigned int) * uiNodes);
+		memset(pSolver->m_aucMark, 0, uiNodes);
+		pSolver->m_uiSleepNodes = uiNodes;
+		pSolver->m_uiSleepArcs = pSystem->m_Topology.m_uiArcCount;
+		pSolver->m_bActiveValid = false;
+		updateAdjacency(pSystem);
+	}
+}
+
+// appends arc uiArc of the topology to the active arc arrays
+static inline void solverActiveArc(raaSolver *pSolver, const raaTopology *pTopology, unsigned int uiArc)
+{
+	raaTopology *pActive = &(pSolver->m_ActiveArcs);
+
+	if (pActive->m_uiArcCount == pActive->m_uiArcCapacity)
+	{
+		unsigned int uiCapacity = pActive->m_uiArcCapacity ? pActive->m_uiArcCapacity * 2 : csg_uiSolverArcChunk;
+		pActive->m_auiArcNode0 = solverGrowArray(pActive->m_auiArcNode0, pActive->m_uiArcCount, uiCapacity);
+		pActive->m_auiArcNode1 = solverGrowArray(pActive->m_auiArcNode1, pActive->m_uiArcCount, uiCapacity);
+		pActive->m_afArcSpringCoef = solverGrowArray(pActive->m_afArcSpringCoef, pActive->m_uiArcCount, uiCapacity);
+		pActive->m_afArcIdealLen = solverGrowArray(pActive->m_afArcIdealLen, pActive->m_uiArcCount, uiCapacity);
+		pActive->m_uiArcCapacity = uiCapacity;
+	}
+
+	unsigned int uiIndex = pActive->m_uiArcCount++;
+	pActive->m_auiArcNode0[uiIndex] = pTopology->m_auiArcNode0[uiArc];
+	pActive->m_auiArcNode1[uiIndex] = pTopology->m_auiArcNode1[uiArc];
+	pActive->m_afArcSpringCoef[uiIndex] = pTopology->m_afArcSpringCoef[uiArc];
+	pActive->m_afArcIdealLen[uiIndex] = pTopology->m_afArcIdealLen[uiArc];
+}
+
+// rebuilds the active node list and arc arrays after nodes fell asleep or woke. The awake nodes come from a scan of the
+// quiet counts, everything else is found through the adjacency of the awake nodes and the boundary
+static void solverBuildActive(raaSolver *pSolver, raaSystem *pSystem)
+{
+	const raaTopology *pTopology = &(pSystem->m_Topology);
+	unsigned int *auiQuiet = pSolver->m_auiQuiet, *auiActive = pSolver->m_auiActive;
+	unsigned char *aucMark = pSolver->m_aucMark;
+	unsigned int uiActive = 0;
+
+	for (unsigned int i = 0; i < pSolver->m_uiSleepNodes; i++) if (auiQuiet[i] < pSolver->m_uiSleepSteps)
+	{
+		auiActive[uiActive++] = i;
+		aucMark[i] = 1;
+	}
+	pSolver->m_uiAwake = uiActive;
+
+	// boundary (mark 2) is the sleeping neighbours of awake nodes, the far ends of boundary arcs (mark 3) only need clearing
+	for (unsigned int uiRing = 0; uiRing < 2; uiRing++)
+	{
+		unsigned int uiBegin = uiRing ? pSolver->m_uiAwake : 0, uiEnd = uiActive;
+		for (unsigned int k = uiBegin; k < uiEnd; k++)
+		{
+			unsigned int uiNode = auiActive[k];
+			for (unsigned int j = pTopology->m_auiOffset[uiNode]; j < pTopology->m_auiOffset[uiNode + 1]; j++)
+			{
+				unsigned int uiNeighbour = pTopology->m_auiNeighbour[j];
+				if (!aucMark[uiNeighbour])
+				{
+					aucMark[uiNeighbour] = (unsigned char)(uiRing + 2);
+					auiActive[uiActive++] = uiNeighbour;
+				}
+			}
+		}
+		if (!uiRing) pSolver->m_uiBoundary = uiActive;
+	}
+	pSolver->m_uiActive = uiActive;
+
+	// every arc with an awake or boundary end, once
+	pSolver->m_ActiveArcs.m_uiArcCount = 0;
+	for (unsigned int k = 0; k < pSolver->m_uiBoundary; k++)
+	{
+		unsigned int uiNode = auiActive[k];
+		for (unsigned int j = pTopology->m_auiOffset[uiNode]; j < pTopology->m_auiOffset[uiNode + 1]; j++)
+		{
+			unsigned int uiNeighbour = pTopology->m_auiNeighbour[j];
+			if (aucMark[uiNeighbour] == 3 || uiNode < uiNeighbour) solverActiveArc(pSolver, pTopology, pTopology->m_auiNeighbourArc[j]);
+		}
+	}
+
+	for (unsigned int k = 0; k < uiActive; k++) aucMark[auiActive[k]] = 0;
+	pSolver->m_bActiveValid = true;
+}
+
+// after a step - counts quiet steps for the awake nodes, putting them to sleep with zero velocity, and wakes boundary
+// nodes whose now complete force has grown past the wake threshold
+static void solverSleepUpdate(raaSolver *pSolver, raaNodeStore *pStore)
+{
+	float fStep2 = pSolver->m_fSleepDisplacement * pSolver->m_fSleepDisplacement;
+	float fAcceleration2 = pSolver->m_fSleepAcceleration * pSolver->m_fSleepAcceleration;
+	float fWake2 = fAcceleration2 * csg_fSolverWakeRatio * csg_fSolverWakeRatio;
+	float fScale2 = pSolver->m_uiIntegrator == csg_uiSolverIntegratorLegacy ? 1.0f / (pSolver->m_fTimeStep * pSolver->m_fTimeStep) : pSolver->m_fTimeStep * pSolver->m_fTimeStep;
+
+	for (unsigned int k = 0; k < pSolver->m_uiBoundary; k++)
+	{
+		unsigned int i = pSolver->m_auiActive[k];
+		float *pfVelocity = pStore->m_afVelocity + i * 4;
+		const float *pfForce = pStore->m_afForce + i * 4;
+		float fInvMass = pStore->m_afInvMass[i];
+		float fForce2 = (pfForce[0] * pfForce[0] + pfForce[1] * pfForce[1] + pfForce[2] * pfForce[2]) * fInvMass * fInvMass;
+
+		if (k < pSolver->m_uiAwake)
+		{
+			float fSpeed2 = pfVelocity[0] * pfVelocity[0] + pfVelocity[1] * pfVelocity[1] + pfVelocity[2] * pfVelocity[2];
+
+			if (fSpeed2 * fScale2 < fStep2 && fForce2 < fAcceleration2)
+			{
+				if (++pSolver->m_auiQuiet[i] >= pSolver->m_uiSleepSteps)
+				{
+					pfVelocity[0] = pfVelocity[1] = pfVelocity[2] = 0.0f;
+					pSolver->m_bActiveValid = false;
+				}
+			}
+			else pSolver->m_auiQuiet[i] = 0;
+		}
+		else if (fForce2 > fWake2)
+		{
+			pSolver->m_auiQuiet[i] = 0;
+			pSolver->m_bActiveValid = false;
+		}
+	}
+}
+
+// calls fRun(uiBegin, uiEnd) for each run of consecutive node indices in auiNodes[uiBegin, uiEnd)
+template<class F> static inline void solverRuns(const unsigned int *auiNodes, unsigned int uiBegin, unsigned int uiEnd, F fRun)
+{
+	for (unsigned int k = uiBegin; k < uiEnd;)
+	{
+		unsigned int uiRun = k + 1;
+		while (uiRun < uiEnd && auiNodes[uiRun] == auiNodes[uiRun - 1] + 1) uiRun++;
+		fRun(auiNodes[k], auiNodes[uiRun - 1] + 1);
+		k = uiRun;
+	}
+}
+
+// adds the kinetic energy of nodes [uiBegin, uiEnd) to pfStats[1], pinned nodes (zero inverse mass) carry none. A non zero
+// fLegacyStep also records the furthest legacy move, |v| / dt, in pfStats[0]
+template<class T> static inline void solverNodeStats(const T *atVelocity, const float *afInvMass, unsigned int uiBegin, unsigned int uiEnd, float fLegacyStep, float *pfStats)
+{
+	float fMax = pfStats[0], fEnergy = 0.0f;
+
+	for (unsigned int i = uiBegin; i < uiEnd; i++)
+	{
+		const T *ptVelocity = atVelocity + i * 4;
+		float fSpeed2 = (float)(ptVelocity[0] * ptVelocity[0] + ptVelocity[1] * ptVelocity[1] + ptVelocity[2] * ptVelocity[2]);
+
+		if (afInvMass[i] > 0.0f) fEnergy += 0.5f * fSpeed2 / afInvMass[i];
+		if (fLegacyStep > 0.0f)
+		{
+			float fStep2 = fSpeed2 / (fLegacyStep * fLegacyStep);
+			if (!(fStep2 <= fMax)) fMax = fStep2;
+		}
+	}
+
+	pfStats[0] = fMax;
+	pfStats[1] += fEnergy;
+}
+
+// clears the per thread statistics for a step
+static void solverClearStats(raaSolver *pSolver)
+{
+	unsigned int uiLine = csg_uiSystemAlignment / sizeof(float);
+	for (unsigned int t = 0; t < pSolver->m_uiStatSlots; t++) pSolver->m_afThreadStats[t * uiLine] = pSolver->m_afThreadStats[t * uiLine + 1] = 0.0f;
+}
+
+// combines the per thread statistics in slot order, returns the furthest move squared
+static float solverGatherStats(raaSolver *pSolver)
+{
+	unsigned int uiLine = csg_uiSystemAlignment / sizeof(float);
+	float fMax2 = 0.0f, fEnergy = 0.0f;
+
+	for (unsigned int t = 0; t < pSolver->m_uiStatSlots; t++)
+	{
+		const float *pfStats = pSolver->m_afThreadStats + t * uiLine;
+		if (!(pfStats[0] <= fMax2)) fMax2 = pfStats[0];
+		fEnergy += pfStats[1];
+	}
+
+	pSolver->m_fLastDisplacement = sqrtf(fMax2);
+	pSolver->m_fKineticEnergy = fEnergy;
+	return fMax2;
+}
+
+static inline float solverSqrt(float fValue) { return sqrtf(fValue); }
+static inline double solverSqrt(double dValue) { return sqrt(dValue); }
+
+// sets the force of node uiNode to the spring force of its arcs, plus the store force if bNodeForces, summed as P says in
+// adjacency row order so any thread gets the same result. Written to atForce and the store force, one array without a shadow
+template<class P> static inline void solverGatherArcs(const raaTopology *pTopology, const typename P::Real *atPosition, typename P::Real *atForce, float *afForce, bool bNodeForces, unsigned int uiNode)
+{
+	typedef typename P::Compute Compute;
+	const typename P::Real *ptPosition = atPosition + uiNode * 4;
+	typename P::Accumulator aSum[3];
+
+	for (int i = 0; i < 3; i++) aSum[i].init(bNodeForces ? afForce[uiNode * 4 + i] : 0.0f);
+
+	for (unsigned int j = pTopology->m_auiOffset[uiNode]; j < pTopology->m_auiOffset[uiNode + 1]; j++)
+	{
+		const typename P::Real *ptNeighbour = atPosition + pTopology->m_auiNeighbour[j] * 4;
+
+		Compute atDelta[3];
+		for (int i = 0; i < 3; i++) atDelta[i] = (Compute)ptNeighbour[i] - (Compute)ptPosition[i];
+		Compute tDistance = solverSqrt(atDelta[0] * atDelta[0] + atDelta[1] * atDelta[1] + atDelta[2] * atDelta[2]);
+
+		if (tDistance > 0)
+		{
+			Compute tScale = (tDistance - pTopology->m_afIdealLen[j]) * pTopology->m_afSpringCoef[j] / tDistance;
+			for (int i = 0; i < 3; i++) aSum[i].add(atDelta[i] * tScale);
+		}
+	}
+
+	for (int i = 0; i < 3; i++)
+	{
+		atForce[uiNode * 4 + i] = (typename P::Real)aSum[i].value();
+		afForce[uiNode * 4 + i] = (float)aSum[i].value();
+	}
+}
+
+// the deterministic mode and every precision but float gather the arc forces per node
+static inline bool solverGathers(const raaSolver *pSolver)
+{
+	return pSolver->m_bDeterministic || pSolver->m_uiPrecision != csg_uiSolverPrecisionFloat;
+}
+
+// calls fBlock(uiBegin, uiEnd, uiBlock) for consecutive blocks of csg_uiSolverNodeChunk over [0, uiCount), on pPool if
+// given. The blocks are the same for any pool size, only which thread runs them changes
+template<class F> static void solverBlocks(raaThreadPool *pPool, unsigned int uiCount, F fBlock)
+{
+	auto fRange = [&fBlock](unsigned int uiBegin, unsigned int uiEnd, unsigned int)
+	{
+		for (unsigned int b = uiBegin; b < uiEnd; b += csg_uiSolverNodeChunk) fBlock(b, uiEnd - b > csg_uiSolverNodeChunk ? b + csg_uiSolverNodeChunk : uiEnd, b / csg_uiSolverNodeChunk);
+	};
+
+	if (pPool) threadPoolFor(pPool, uiCount, csg_uiSolverNodeChunk, fRange);
+	else fRange(0, uiCount, 0);
+}
+
+// one force evaluation at the current positions, then fNodes(uiBegin, uiEnd, uiThread) over nodes with a complete force.
+// Sleeping evaluates only the active arcs and gives fNodes the runs of awake nodes, gathering (solverGathers) sums per node
+// from atPosition into atForce, the state arrays of P, and gives fNodes the node block in place of the thread
+template<class P, class F> static void solverPass(raaSolver *pSolver, raaSystem *pSystem, bool bSleep, const typename P::Real *atPosition, typename P::Real *atForce, F fNodes)
+{
+	raaNodeStore *pStore = &(pSystem->m_Nodes);
+	const raaTopology *pTopology = bSleep ? &(pSolver->m_ActiveArcs) : &(pSystem->m_Topology);
+	raaArcKernel *pArcKernel = solverArcKernel(pSolver->m_uiKernel);
+	bool bNodeForces = solverNodeForcesOn(pSolver);
+	const unsigned int *auiActive = pSolver->m_auiActive;
+	unsigned int uiAwake = pSolver->m_uiAwake;
+
+	if (solverGathers(pSolver))
+	{
+		raaThreadPool *pPool = pSolver->m_bParallel ? (pSolver->m_pPool ? pSolver->m_pPool : threadPoolDefault()) : 0;
+		const raaTopology *pAdjacency = &(pSystem->m_Topology);
+
+		if (bNodeForces) solverNodeForces(pSolver, pStore, pPool);
+
+		// every node that needs its force, the awake nodes and the boundary when sleeping, gathers it before any node moves
+		solverBlocks(pPool, bSleep ? pSolver->m_uiBoundary : pStore->m_uiCount, [pStore, pAdjacency, atPosition, atForce, auiActive, bSleep, bNodeForces](unsigned int uiBegin, unsigned int uiEnd, unsigned int)
+		{
+			for (unsigned int k = uiBegin; k < uiEnd; k++) solverGatherArcs<P>(pAdjacency, atPosition, atForce, pStore->m_afForce, bNodeForces, bSleep ? auiActive[k] : k);
+		});
+
+		solverBlocks(pPool, bSleep ? uiAwake : pStore->m_uiCount, [auiActive, bSleep, &fNodes](unsigned int uiBegin, unsigned int uiEnd, unsigned int uiBlock)
+		{
+			if (bSleep) solverRuns(auiActive, uiBegin, uiEnd, [&fNodes, uiBlock](unsigned int uiRunBegin, unsigned int uiRunEnd) { fNodes(uiRunBegin, uiRunEnd, uiBlock); });
+			else fNodes(uiBegin, uiEnd, uiBlock);
+		});
+		return;
+	}
+
+	if (!pSolver->m_bParallel)
+	{
+		if (bNodeForces) solverNodeForces(pSolver, pStore, 0);
+		else if (!bSleep) memset(pStore->m_afForce, 0, sizeof(float) * 4 * pStore->m_uiCount);
+		else for (unsigned int k = 0; k < pSolver->m_uiActive; k++)
+		{
+			float *pfForce = pStore->m_afForce + auiActive[k] * 4;
+			pfForce[0] = pfForce[1] = pfForce[2] = 0.0f;
+		}
+
+		pArcKernel(pTopology, pStore->m_afPosition, pStore->m_afForce, 0, pTopology->m_uiArcCount);
+
+		if (bSleep) solverRuns(auiActive, 0, uiAwake, [&fNodes](unsigned int uiBegin, unsigned int uiEnd) { fNodes(uiBegin, uiEnd, 0); });
+		else fNodes(0, pStore->m_uiCount, 0);
+		return;
+	}
+
+	raaThreadPool *pPool = pSolver->m_pPool ? pSolver->m_pPool : threadPoolDefault();
+	unsigned int uiThreads = pSolver->m_uiThreadBuffers;
+	float *afThreadForce = pSolver->m_afThreadForce;
+	unsigned int uiStride = pSolver->m_uiThreadStride;
+	const float *afPosition = pStore->m_afPosition;
+
+	if (bNodeForces) solverNodeForces(pSolver, pStore, pPool);
+
+	// arcs - each thread accumulates into its own buffer
+	threadPoolFor(pPool, pTopology->m_uiArcCount, csg_uiSolverArcChunk, [pTopology, afPosition, afThreadForce, uiStride, pArcKernel](unsigned int uiBegin, unsigned int uiEnd, unsigned int uiThread)
+	{
+		pArcKernel(pTopology, afPosition, afThreadForce + uiThread * uiStride, uiBegin, uiEnd);
+	});
+
+	// nodes - reduce the thread buffers into the store force, clearing them for the next pass, then integrate
+	auto fReduce = [pStore, afThreadForce, uiStride, uiThreads, bNodeForces](unsigned int i)
+	{
+		float *pfForce = pStore->m_afForce + i * 4;
+		if (!bNodeForces) pfForce[0] = pfForce[1] = pfForce[2] = 0.0f;
+
+		for (unsigned int t = 0; t < uiThreads; t++)
+		{
+			float *pfThreadForce = afThreadForce + t * uiStride + i * 4;
+			for (int j = 0; j < 3; j++) pfForce[j] += pfThreadForce[j];
+			pfThreadForce[0] = pfThreadForce[1] = pfThreadForce[2] = 0.0f;
+		}
+	};
+
+	if (bSleep)
+	{
+		threadPoolFor(pPool, pSolver->m_uiActive, csg_uiSolverNodeChunk, [auiActive, uiAwake, &fReduce, &fNodes](unsigned int uiBegin, unsigned int uiEnd, unsigned int uiThread)
+		{
+			for (unsigned int k = uiBegin; k < uiEnd; k++) fReduce(auiActive[k]);
+			if (uiBegin < uiAwake) solverRuns(auiActive, uiBegin, uiEnd < uiAwake ? uiEnd : uiAwake, [&fNodes, uiThread](unsigned int uiRunBegin, unsigned int uiRunEnd) { fNodes(uiRunBegin, uiRunEnd, uiThread); });
+		});
+		return;
+	}
+
+	threadPoolFor(pPool, pStore->m_uiCount, csg_uiSolverNodeChunk, [&fReduce, &fNodes](unsigned int uiBegin, unsigned int uiEnd, unsigned int uiThread)
+	{
+		for (unsigned int i = uiBegin; i < uiEnd; i++) fReduce(i);
+		fNodes(uiBegin, uiEnd, uiThread);
+	});
+}
+
+// largest stable explicit step, 2 / omega for the stiffest node with omega^2 bounded by twice its summed spring
+// coefficients over its mass (gershgorin on the spring stiffness)
+static float solverStableStep(raaSystem *pSystem)
+{
+	const raaTopology *pTopology = &(pSystem->m_Topology);
+	const raaNodeStore *pStore = &(pSystem->m_Nodes);
+	float fMax = 0.0f;
+
+	if (!updateAdjacency(pSystem)) return csg_fSolverMaxTimeStep;
+
+	for (unsigned int i = 0; i < pStore->m_uiCount; i++)
+	{
+		float fStiffness = 0.0f;
+		for (unsigned int j = pTopology->m_auiOffset[i]; j < pTopology->m_auiOffset[i + 1]; j++) fStiffness += pTopology->m_afSpringCoef[j];
+		fStiffness *= pStore->m_afInvMass[i];
+		if (fStiffness > fMax) fMax = fStiffness;
+	}
+
+	return fMax > 0.0f ? csg_fSolverStableFraction * 2.0f / sqrtf(2.0f * fMax) : csg_fSolverMaxTimeStep;
+}
+
+// rounds the shadow position and velocity of nodes [uiBegin, uiEnd) into the store
+template<class T> static inline void solverShadowStore(raaNodeStore *pStore, const T *atPosition, const T *atVelocity, unsigned int uiBegin, unsigned int uiEnd)
+{
+	for (unsigned int i = uiBegin * 4; i < uiEnd * 4; i += 4) for (int j = 0; j < 3; j++)
+	{
+		pStore->m_afPosition[i + j] = (float)atPosition[i + j];
+		pStore->m_afVelocity[i + j] = (float)atVelocity[i + j];
+	}
+}
+
+// one step of integrator I in precision P, s_uiStages force evaluations per attempt. With the adaptive step a step that
+// moves any node further than the limit, or goes non-finite, is undone from the snapshot and retried at a smaller dt
+template<class I, class P> static void solverStepIntegrator(raaSolver *pSolver, raaSystem *pSystem, bool bSleep)
+{
+	typedef typename P::Real Real;
+	raaNodeStore *pStore = &(pSystem->m_Nodes);
+	unsigned int uiNodes = pStore->m_uiCount;
+	unsigned int uiLine = csg_uiSystemAlignment / sizeof(float);
+	float *afThreadStats = pSolver->m_afThreadStats;
+	float fLimit2 = pSolver->m_fMaxDisplacement * pSolver->m_fMaxDisplacement;
+
+	Real *atPosition, *atVelocity, *atForce;
+	solverStateArrays(pSolver, pStore, atPosition, atVelocity, atForce);
+
+	raaIntegratorState<Real> State;
+	memset(&State, 0, sizeof(raaIntegratorState<Real>));
+	State.m_atPosition = atPosition;
+	State.m_atVelocity = atVelocity;
+	State.m_atForce = atForce;
+	State.m_afInvMass = pStore->m_afInvMass;
+	State.m_afCarry = pSolver->m_uiPrecision == csg_uiSolverPrecisionCompensated ? pSolver->m_afCarry : 0;
+	State.m_tFriction = pSolver->m_fFriction;
+	State.m_tDamping = pSolver->m_fDamping;
+	State.m_bPrimed = pSolver->m_bPrimed;
+
+	if (pSolver->m_bAdaptive)
+	{
+		if (pSolver->m_fStableStep <= 0.0f) pSolver->m_fStableStep = solverStableStep(pSystem);
+		if (pSolver->m_fTimeStep > pSolver->m_fStableStep) solverSetTimeStep(pSolver, pSolver->m_fStableStep);
+	}
+
+	Real *atSnapshot = 0;
+	if (I::s_uiStages > 1 || pSolver->m_bAdaptive)
+	{
+		solverReserveStage(pSolver, sizeof(Real) * 24 * uiNodes);
+		atSnapshot = (Real*)pSolver->m_pStage;
+		State.m_atPosition0 = atSnapshot + 8 * uiNodes;
+		State.m_atVelocity0 = State.m_atPosition0 + 4 * uiNodes;
+		State.m_atPositionSum = State.m_atVelocity0 + 4 * uiNodes;
+		State.m_atVelocitySum = State.m_atPositionSum + 4 * uiNodes;
+	}
+
+	if (pSolver->m_bAdaptive)
+	{
+		memcpy(atSnapshot, atPosition, sizeof(Real) * 4 * uiNodes);
+		memcpy(atSnapshot + 4 * uiNodes, atVelocity, sizeof(Real) * 4 * uiNodes);
+	}
+
+	float fMax2;
+	do
+	{
+		State.m_tTimeStep = pSolver->m_fTimeStep;
+		solverClearStats(pSolver);
+
+		for (unsigned int uiStage = 0; uiStage < I::s_uiStages; uiStage++)
+		{
+			solverPass<P>(pSolver, pSystem, bSleep, atPosition, atForce, [&State, pStore, uiStage, afThreadStats, uiLine](unsigned int uiBegin, unsigned int uiEnd, unsigned int uiThread)
+			{
+				float *pfStats = afThreadStats + uiThread * uiLine;
+				float fMax = pfStats[0];
+				for (unsigned int i = uiBegin; i < uiEnd; i++)
+				{
+					float fStep2 = I::stage(State, uiStage, i);
+					if (!(fStep2 <= fMax)) fMax = fStep2; // lets a nan through to the controller
+				}
+				pfStats[0] = fMax;
+
+				if (P::s_bShadow) solverShadowStore(pStore, State.m_atPosition, State.m_atVelocity, uiBegin, uiEnd);
+				if (uiStage == I::s_uiStages - 1) solverNodeStats(State.m_atVelocity, State.m_afInvMass, uiBegin, uiEnd, 0.0f, pfStats);
+			});
+		}
+
+		fMax2 = solverGatherStats(pSolver);
+
+		if (!pSolver->m_bAdaptive || fMax2 <= fLimit2 || pSolver->m_fTimeStep <= csg_fSolverMinTimeStep) break;
+
+		memcpy(atPosition, atSnapshot, sizeof(Real) * 4 * uiNodes);
+		memcpy(atVelocity, atSnapshot + 4 * uiNodes, sizeof(Real) * 4 * uiNodes);
+		if (P::s_bShadow) solverShadowStore(pStore, atPosition, atVelocity, 0, uiNodes);
+		solverSetTimeStep(pSolver, pSolver->m_fTimeStep * csg_fSolverStepShrink);
+	} while (true);
+
+	pSolver->m_bPrimed = true;
+
+	// grow while the motion is small, but never past friction * dt = 1 where the damping term starts to overshoot or past
+	// the spring stability limit
+	if (pSolver->m_bAdaptive && fMax2 < 0.25f * fLimit2 && pSolver->m_fTimeStep * pSolver->m_fFriction < 1.0f)
+	{
+		float fGrown = pSolver->m_fTimeStep * csg_fSolverStepGrow;
+		solverSetTimeStep(pSolver, fGrown < pSolver->m_fStableStep ? fGrown : pSolver->m_fStableStep);
+	}
+}
+
+// every integrator, legacy included, for the precisions without simd kernels
+template<class P> static void solverStepPrecision(raaSolver *pSolver, raaSystem *pSystem, bool bSleep)
+{
+	switch (pSolver->m_uiIntegrator)
+	{
+	case csg_uiSolverIntegratorEuler:
+		solverStepIntegrator<raaIntegratorEuler<P>, P>(pSolver, pSystem, bSleep);
+		break;
+	case csg_uiSolverIntegratorVerlet:
+		solverStepIntegrator<raaIntegratorVerlet<P>, P>(pSolver, pSystem, bSleep);
+		break;
+	case csg_uiSolverIntegratorRK4:
+		solverStepIntegrator<raaIntegratorRK4<P>, P>(pSolver, pSystem, bSleep);
+		break;
+	default:
+		solverStepIntegrator<raaIntegratorLegacy<P>, P>(pSolver, pSystem, bSleep);
+		break;
+	}
+}
+
+// position based step, the node forces and friction predict, the arc constraints correct and the velocity follows the
+// move. Friction is implicit, v = (v + a dt) / (1 + friction dt), so it cannot overshoot at a large dt
+static void solverStepPBD(raaSolver *pSolver, raaSystem *pSystem)
+{
+	raaNodeStore *pStore = &(pSystem->m_Nodes);
+	raaTopology *pTopology = &(pSystem->m_Topology);
+	raaThreadPool *pPool = pSolver->m_bParallel ? (pSolver->m_pPool ? pSolver->m_pPool : threadPoolDefault()) : 0;
+	unsigned int uiNodes = pStore->m_uiCount;
+	unsigned int uiLine = csg_uiSystemAlignment / sizeof(float);
+	float *afThreadStats = pSolver->m_afThreadStats;
+	float fTimeStep = pSolver->m_fTimeStep, fFriction = pSolver->m_fFriction;
+	bool bNodeForces = solverNodeForcesOn(pSolver);
+
+	if (!pSolver->m_bColoured || pSolver->m_Constraints.m_uiArcCount != pTopology->m_uiArcCount)
+	{
+		updateAdjacency(pSystem);
+		constraintColour(&(pSolver->m_Constraints), pTopology);
+		pSolver->m_bColoured = true;
+	}
+
+	solverReserveStage(pSolver, sizeof(float) * 4 * uiNodes);
+	float *afStart = (float*)pSolver->m_pStage;
+
+	if (bNodeForces) solverNodeForces(pSolver, pStore, pPool);
+
+	solverBlocks(pPool, uiNodes, [pStore, afStart, fTimeStep, fFriction, bNodeForces](unsigned int uiBegin, unsigned int uiEnd, unsigned int)
+	{
+		for (unsigned int i = uiBegin; i < uiEnd; i++)
+		{
+			float *pfPosition = pStore->m_afPosition + i * 4;
+			float *pfVelocity = pStore->m_afVelocity + i * 4;
+			const float *pfForce = pStore->m_afForce + i * 4;
+			float fInvMass = pStore->m_afInvMass[i];
+
+			for (int k = 0; k < 3; k++)
+			{
+				afStart[i * 4 + k] = pfPosition[k];
+				pfVelocity[k] = (pfVelocity[k] + (bNodeForces ? pfForce[k] * fInvMass * fTimeStep : 0.0f)) / (1.0f + fFriction * fTimeStep);
+				pfPosition[k] += pfVelocity[k] * fTimeStep;
+			}
+		}
+	});
+
+	constraintBegin(&(pSolver->m_Constraints));
+	for (unsigned int k = 0; k < pSolver->m_uiConstraintIterations; k++) constraintProject(&(pSolver->m_Constraints), pTopology, pStore->m_afPosition, pStore->m_afInvMass, fTimeStep, pPool);
+
+	solverClearStats(pSolver);
+	solverBlocks(pPool, uiNodes, [pStore, afStart, fTimeStep, afThreadStats, uiLine](unsigned int uiBegin, unsigned int uiEnd, unsigned int uiBlock)
+	{
+		float *pfStats = afThreadStats + uiBlock * uiLine;
+		float fMax = pfStats[0];
+
+		for (unsigned int i = uiBegin; i < uiEnd; i++)
+		{
+			float fStep2 = 0.0f;
+			for (int k = 0; k < 3; k++)
+			{
+				float fStep = pStore->m_afPosition[i * 4 + k] - afStart[i * 4 + k];
+				pStore->m_afVelocity[i * 4 + k] = fStep / fTimeStep;
+				fStep2 += fStep * fStep;
+			}
+			if (!(fStep2 <= fMax)) fMax = fStep2;
+		}
+
+		pfStats[0] = fMax;
+		solverNodeStats(pStore->m_afVelocity, pStore->m_afInvMass, uiBegin, uiEnd, 0.0f, pfStats);
+	});
+	solverGatherStats(pSolver);
+}
+
+// float precision, the legacy integrator runs the simd kernels
+static void solverStepFloat(raaSolver *pSolver, raaSystem *pSystem, bool bSleep)
+{
+	raaNodeStore *pStore = &(pSystem->m_Nodes);
+
+	switch (pSolver->m_uiIntegrator)
+	{
+	case csg_uiSolverIntegratorEuler:
+		solverStepIntegrator<raaIntegratorEuler<raaPrecisionFloat>, raaPrecisionFloat>(pSolver, pSystem, bSleep);
+		break;
+	case csg_uiSolverIntegratorVerlet:
+		solverStepIntegrator<raaIntegratorVerlet<raaPrecisionFloat>, raaPrecisionFloat>(pSolver, pSystem, bSleep);
+		break;
+	case csg_uiSolverIntegratorRK4:
+		solverStepIntegrator<raaIntegratorRK4<raaPrecisionFloat>, raaPrecisionFloat>(pSolver, pSystem, bSleep);
+		break;
+	default:
+		{
+			raaIntegrateKernel *pIntegrateKernel = pSolver->m_bDeterministic ? solverIntegrateScalar : solverIntegrateKernel(pSolver->m_uiKernel);
+			float *afThreadStats = pSolver->m_afThreadStats;
+			unsigned int uiLine = csg_uiSystemAlignment / sizeof(float);
+
+			solverClearStats(pSolver);
+			solverPass<raaPrecisionFloat>(pSolver, pSystem, bSleep, pStore->m_afPosition, pStore->m_afForce, [pSolver, pStore, pIntegrateKernel, afThreadStats, uiLine](unsigned int uiBegin, unsigned int uiEnd, unsigned int uiThread)
+			{
+				pIntegrateKernel(pSolver, pStore, uiBegin, uiEnd);
+				solverNodeStats(pStore->m_afVelocity, pStore->m_afInvMass, uiBegin, uiEnd, pSolver->m_fTimeStep, afThreadStats + uiThread * uiLine);
+			});
+			solverGatherStats(pSolver);
+		}
+		break;
+	}
+}
+
+void solverStep(raaSolver* pSolver, raaSystem* pSystem)
+{
+	if (pSolver && pSystem)
+	{
+		raaNodeStore *pStore = &(pSystem->m_Nodes);
+		raaTopology *pTopology = &(pSystem->m_Topology);
+
+		if (!pTopology->m_bValid)
+		{
+			buildTopology(pSystem);
+			solverWake(pSolver);
+		}
+
+		// at rest, a single probe step every m_uiRestProbe calls picks up changes nobody reported
+		if (solverConverged(pSolver) && ++pSolver->m_uiProbeCount < pSolver->m_uiRestProbe) return;
+		pSolver->m_uiProbeCount = 0;
+
+		// sleeping nodes are skipped, the repulsion couples every pair of nodes and the collision any pair that comes close,
+		// so either runs the full system, as do the constraints that move both ends of an arc at once
+		bool bPBD = pSolver->m_uiIntegrator == csg_uiSolverIntegratorPBD;
+		bool bSleep = pSolver->m_bSleeping && !solverNodeForcesOn(pSolver) && !bPBD;
+		if (bSleep)
+		{
+			solverSleepReserve(pSolver, pSystem);
+			if (!pSolver->m_bActiveValid) solverBuildActive(pSolver, pSystem);
+		}
+		else pSolver->m_uiAwake = pStore->m_uiCount;
+		if (solverGathers(pSolver)) updateAdjacency(pSystem);
+		if (!bPBD && (pSolver->m_uiPrecision == csg_uiSolverPrecisionCompensated || pSolver->m_uiPrecision == csg_uiSolverPrecisionDouble)) solverReserveShadow(pSolver, pStore, bSleep);
+
+		// statistics per thread, or per node block when gathering so their sums do not depend on the pool
+		if (solverGathers(pSolver) || bPBD)
+		{
+			unsigned int uiNodes = bSleep ? pSolver->m_uiAwake : pStore->m_uiCount;
+			solverReserveStats(pSolver, uiNodes ? (uiNodes + csg_uiSolverNodeChunk - 1) / csg_uiSolverNodeChunk : 1);
+		}
+		else if (pSolver->m_bParallel)
+		{
+			unsigned int uiThreads = threadPoolThreads(pSolver->m_pPool ? pSolver->m_pPool : threadPoolDefault());
+			solverReserve(pSolver, uiThreads, pStore->m_uiCount);
+			solverReserveStats(pSolver, uiThreads);
+		}
+		else solverReserveStats(pSolver, 1);
+
+		if (bPBD) solverStepPBD(pSolver, pSystem);
+		else switch (pSolver->m_uiPrecision)
+		{
+		case csg_uiSolverPrecisionMixed:
+			solverStepPrecision<raaPrecisionMixed>(pSolver, pSystem, bSleep);
+			break;
+		case csg_uiSolverPrecisionCompensated:
+			solverStepPrecision<raaPrecisionCompensated>(pSolver, pSystem, bSleep);
+			break;
+		case csg_uiSolverPrecisionDouble:
+			solverStepPrecision<raaPrecisionDouble>(pSolver, pSystem, bSleep);
+			break;
+		default:
+			solverStepFloat(pSolver, pSystem, bSleep);
+			break;
+		}
+
+		if (bSleep) solverSleepUpdate(pSolver, pStore);
+
+		// converged once the motion stays under both rest thresholds for m_uiRestSteps steps. Legacy moves a node by
+		// (v + F/m) * (1 - damping) whatever dt and keeps dt times that move as its velocity
+		bool bLegacy = pSolver->m_uiIntegrator == csg_uiSolverIntegratorLegacy;
+		float fStepTime = bLegacy ? 1.0f - pSolver->m_fDamping : pSolver->m_fTimeStep;
+		float fSpeedScale = bLegacy ? fStepTime * pSolver->m_fTimeStep : 1.0f;
+
+		if (pSolver->m_fLastDisplacement <= pSolver->m_fRestDisplacement * fStepTime && pSolver->m_fKineticEnergy <= pSolver->m_fRestEnergy * pStore->m_uiCount * fSpeedScale * fSpeedScale)
+		{
+			if (++pSolver->m_uiQuietSteps >= pSolver->m_uiRestSteps) pSolver->m_bConverged = true;
+		}
+		else
+		{
+			pSolver->m_bConverged = false;
+			pSolver->m_uiQuietSteps = 0;
+		}
+	}
+}
@@ -0,0 +1,179 @@
+#pragma once
+#ifdef _DEBUG
+#pragma comment(lib,"raaSystemD")
+#else
+#pragma comment(lib,"raaSystemR")
+#endif
+
+#include "raaSystem.h"
+#include "raaOctree.h"
+#include "raaFMM.h"
+#include "raaGrid.h"
+#include "raaIntegrator.h"
+#include "raaConstraint.h"
+
+// spring solver over the node store and topology arc arrays. Each step clears the forces, writes the node forces (repulsion,
+// collision), adds the spring force of every arc onto its end nodes and integrates the nodes with m_uiIntegrator. In
+// parallel mode each thread accumulates its arcs into its own force buffer, summed into the store force by the node pass.
+
+const static float csg_fSolverDefaultTimeStep = 1.0f;
+const static float csg_fSolverDefaultDamping = 0.99995f;
+const static unsigned int csg_uiSolverArcChunk = 4096;
+const static unsigned int csg_uiSolverNodeChunk = 1024;
+
+const static unsigned int csg_uiSolverRepulsionNone = 0;
+const static unsigned int csg_uiSolverRepulsionBarnesHut = 1; // octree rebuilt each step, O(N log N)
+const static unsigned int csg_uiSolverRepulsionFMM = 2; // fast multipole over the same octree, O(N), order set with fmmSetOrder(&m_FMM, ...)
+
+const static float csg_fSolverDefaultRepulsion = 1.0e6f; // charge constant, force = charge * d / |d|^3
+const static float csg_fSolverDefaultTheta = 0.7f; // barnes-hut opening angle, smaller is more accurate
+const static float csg_fSolverDefaultSoftening = 1.0f; // keeps the force finite for coincident nodes
+const static float csg_fSolverDefaultCollisionStiffness = 1.0f; // force per unit of overlap
+
+// arc force and integration kernels, solverInit picks the widest the cpu supports. The simd kernels process 4 (sse),
+// 8 (avx2) or 16 (avx-512) arcs per iteration, gathering the end positions and scattering the forces back per arc, and
+// integrate 1, 2 or 4 nodes per iteration over the 4 float node vectors.
+const static unsigned int csg_uiSolverKernelScalar = 0;
+const static unsigned int csg_uiSolverKernelSSE = 1;
+const static unsigned int csg_uiSolverKernelAVX2 = 2;
+const static unsigned int csg_uiSolverKernelAVX512 = 3;
+
+const static unsigned int csg_uiSolverIntegratorLegacy = 0; // v = (v + F/m) * dt * (1 - damping), p += v / dt
+const static unsigned int csg_uiSolverIntegratorEuler = 1; // semi-implicit euler
+const static unsigned int csg_uiSolverIntegratorVerlet = 2; // velocity verlet, leapfrog form
+const static unsigned int csg_uiSolverIntegratorRK4 = 3;
+const static unsigned int csg_uiSolverIntegratorPBD = 4; // arcs as distance constraints (raaConstraint.h), stable at any dt so m_bAdaptive is ignored
+const static unsigned int csg_uiSolverIntegrators = 5;
+
+const static float csg_fSolverDefaultFriction = 0.2f; // acceleration -= friction * v, new integrators only
+const static float csg_fSolverMinTimeStep = 0.01f;
+const static float csg_fSolverMaxTimeStep = 10.0f;
+const static float csg_fSolverDefaultMaxDisplacement = 10.0f; // adaptive step, furthest a node may move in one step
+const static float csg_fSolverStepShrink = 0.5f;
+const static float csg_fSolverStepGrow = 1.1f; // applied while the furthest move is under half the limit
+const static float csg_fSolverStableFraction = 0.9f; // of 2 / omega, omega^2 bounded by 2 * max(sum of spring coefs / mass)
+
+const static float csg_fSolverDefaultRestDisplacement = 0.001f; // furthest move in a step, per unit of step time
+const static float csg_fSolverDefaultRestEnergy = 0.001f; // mean kinetic energy per node, at the speed of that move
+const static unsigned int csg_uiSolverDefaultRestSteps = 30;
+const static unsigned int csg_uiSolverDefaultRestProbe = 60;
+
+const static float csg_fSolverDefaultSleepDisplacement = 0.0001f; // furthest move in a step
+const static float csg_fSolverDefaultSleepAcceleration = 0.01f; // |F| / m
+const static unsigned int csg_uiSolverDefaultSleepSteps = 20;
+const static float csg_fSolverWakeRatio = 2.0f;
+
+const static unsigned int csg_uiSolverPrecisionFloat = 0;
+const static unsigned int csg_uiSolverPrecisionMixed = 1; // float storage, double force accumulation
+const static unsigned int csg_uiSolverPrecisionCompensated = 2; // float storage, kahan summation
+const static unsigned int csg_uiSolverPrecisionDouble = 3;
+const static unsigned int csg_uiSolverPrecisions = 4;
+
+// precision a new solver starts with, a build can define it to change the default
+#ifndef RAA_SOLVER_DEFAULT_PRECISION
+#define RAA_SOLVER_DEFAULT_PRECISION csg_uiSolverPrecisionFloat
+#endif
+
+typedef struct _raaSolver
+{
+	float m_fTimeStep;
+	float m_fDamping;
+	bool m_bParallel;
+	bool m_bDeterministic; // bit identical on any pool, arc forces gathered per node in csr order, about twice the arc work
+	unsigned int m_uiKernel;
+	raaThreadPool *m_pPool; // 0 -> default pool
+
+	unsigned int m_uiRepulsion;
+	float m_fRepulsion;
+	float m_fTheta;
+	float m_fSoftening;
+	float m_fFMMTheta;
+	raaOctree m_Octree;
+	raaFMM m_FMM;
+
+	bool m_bCollision; // pushes nodes closer than the sum of their drawn radii apart, pairs from m_Grid, ignores sleeping
+	float m_fCollisionStiffness;
+	raaGrid m_Grid;
+	float *m_afRadius; // per node collision radius
+	float m_fMaxRadius;
+	unsigned int m_uiRadiusCapacity;
+	unsigned int m_uiRadiusNodes; // node count the radii were read for, 0 reads them again
+
+	raaConstraints m_Constraints;
+	unsigned int m_uiConstraintIterations; // sweeps per step
+	bool m_bColoured; // m_Constraints matches the topology, cleared by solverWake
+
+	unsigned int m_uiIntegrator;
+	float m_fFriction;
+	bool m_bAdaptive; // a step moving a node past m_fMaxDisplacement is retried at half dt, dt grows up to m_fStableStep
+	float m_fMaxDisplacement;
+	float m_fLastDisplacement; // furthest any node moved in the last step
+	float m_fStableStep; // adaptive dt ceiling, 0 until measured, cleared by solverWake
+	bool m_bPrimed; // verlet velocities are half a step ahead, cleared by solverWake
+	void *m_pStage; // adaptive snapshot then rk4 start of step and stage sums, 6 arrays of 4 reals per node, pbd start positions
+	unsigned int m_uiStageBytes;
+	float *m_afThreadStats; // per thread (per node block when deterministic) furthest move squared and kinetic energy, one cache line each
+	unsigned int m_uiStatSlots; // lines in use this step
+	unsigned int m_uiStatCapacity;
+
+	float m_fKineticEnergy; // of the last step
+	bool m_bAutoStop; // once converged only probe every m_uiRestProbe calls, until something moves or solverWake
+	float m_fRestDisplacement; // rest thresholds are speeds, per dt, or per 1 - damping for legacy
+	float m_fRestEnergy;
+	unsigned int m_uiRestSteps;
+	unsigned int m_uiRestProbe;
+	unsigned int m_uiQuietSteps; // consecutive steps under the rest thresholds
+	unsigned int m_uiProbeCount;
+	bool m_bConverged;
+
+	bool m_bSleeping; // steps visit only awake nodes and their neighbours, bypassed while repulsion is on
+	float m_fSleepDisplacement;
+	float m_fSleepAcceleration;
+	unsigned int m_uiSleepSteps;
+	unsigned int *m_auiQuiet; // per node consecutive quiet steps, asleep at m_uiSleepSteps
+	unsigned char *m_aucMark; // per node, scratch while building the active set
+	unsigned int *m_auiActive; // awake nodes ascending, then the boundary, then the far ends of the boundary arcs
+	unsigned int m_uiAwake; // m_auiActive split points
+	unsigned int m_uiBoundary;
+	unsigned int m_uiActive;
+	unsigned int m_uiSleepCapacity;
+	unsigned int m_uiSleepNodes; // node and arc count the sleep state was built for
+	unsigned int m_uiSleepArcs;
+	bool m_bActiveValid;
+	raaTopology m_ActiveArcs; // arc arrays of the active arcs, arcs touching an awake or boundary node
+
+	unsigned int m_uiPrecision; // raaPrecision.h, all but float gather the arc forces per node as m_bDeterministic does
+	double *m_adShadow; // double precision position, velocity and force, 4 doubles each per node
+	float *m_afCarry; // compensated precision rounding carry, 4 floats per node
+	unsigned int m_uiShadowCapacity;
+	unsigned int m_uiShadowNodes; // node count the shadow and carry were loaded for, 0 reloads everything
+
+	// per thread force buffers, 4 floats per node, each buffer padded to whole cache lines
+	float *m_afThreadForce;
+	unsigned int m_uiThreadBuffers;
+	unsigned int m_uiThreadStride; // floats
+} raaSolver;
+
+void solverInit(raaSolver *pSolver, bool bParallel=true, raaThreadPool *pPool=0);
+void solverDestroy(raaSolver *pSolver);
+void solverStep(raaSolver *pSolver, raaSystem *pSystem);
+void solverSetTimeStep(raaSolver *pSolver, float fTimeStep); // clamped to [csg_fSolverMinTimeStep, csg_fSolverMaxTimeStep]
+void solverSetIntegrator(raaSolver *pSolver, unsigned int uiIntegrator);
+void solverSetPrecision(raaSolver *pSolver, unsigned int uiPrecision);
+bool solverConverged(const raaSolver *pSolver);
+void solverWake(raaSolver *pSolver); // call after moving nodes or changing the solver settings, wakes every node
+void solverWakeNode(raaSolver *pSolver, unsigned int uiNode); // dense node index, eg a node being dragged
+unsigned int solverAwakeNodes(const raaSolver *pSolver); // awake nodes in the last step, all of them without sleeping
+
+// range kernels, shared by the serial and parallel paths. afForce is added to for arcs [uiBegin, uiEnd), the integration
+// reads the store force and updates velocity and position of nodes [uiBegin, uiEnd)
+typedef void (raaArcKernel)(const raaTopology *pTopology, const float *afPosition, float *afForce, unsigned int uiBegin, unsigned int uiEnd);
+typedef void (raaIntegrateKernel)(const raaSolver *pSolver, raaNodeStore *pStore, unsigned int uiBegin, unsigned int uiEnd);
+
+unsigned int solverKernelSupported(); // widest kernel this cpu can run
+bool solverSetKernel(raaSolver *pSolver, unsigned int uiKernel); // false if the cpu does not support it
+raaArcKernel* solverArcKernel(unsigned int uiKernel);
+raaIntegrateKernel* solverIntegrateKernel(unsigned int uiKernel);
+
+void solverArcForceScalar(const raaTopology *pTopology, const float *afPosition, float *afForce, unsigned int uiBegin, unsigned int uiEnd);
+void solverIntegrateScalar(const raaSolver *pSolver, raaNodeStore *pStore, unsigned int uiBegin, unsigned int uiEnd);
@@ -0,0 +1,277 @@
+#include "stdafx.h"
+#include "raaSolver.h"
+
+// simd solver kernels. Each instruction set is compiled with a per function target (gcc/clang) or directly (msvc) so the
+// library runs on any x86 cpu and only the kernels solverKernelSupported reports are ever called.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define RAA_SOLVER_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define RAA_TARGET_AVX2
+#define RAA_TARGET_AVX512
+#else
+#define RAA_TARGET_AVX2 __attribute__((target("avx2")))
+#define RAA_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#endif
+
+#ifdef RAA_SOLVER_X86
+
+static void solverArcForceSSE(const raaTopology* pTopology, const float* afPosition, float* afForce, unsigned int uiBegin, unsigned int uiEnd)
+{
+	const unsigned int *auiNode0 = pTopology->m_auiArcNode0;
+	const unsigned int *auiNode1 = pTopology->m_auiArcNode1;
+	__m128 vZero = _mm_setzero_ps();
+	unsigned int uiArc = uiBegin;
+
+	for (; uiArc + 4 <= uiEnd; uiArc += 4)
+	{
+		// one delta vector per arc, transposed to x, y, z (and w) lanes across the 4 arcs
+		__m128 vX = _mm_sub_ps(_mm_load_ps(afPosition + auiNode1[uiArc] * 4), _mm_load_ps(afPosition + auiNode0[uiArc] * 4));
+		__m128 vY = _mm_sub_ps(_mm_load_ps(afPosition + auiNode1[uiArc + 1] * 4), _mm_load_ps(afPosition + auiNode0[uiArc + 1] * 4));
+		__m128 vZ = _mm_sub_ps(_mm_load_ps(afPosition + auiNode1[uiArc + 2] * 4), _mm_load_ps(afPosition + auiNode0[uiArc + 2] * 4));
+		__m128 vW = _mm_sub_ps(_mm_load_ps(afPosition + auiNode1[uiArc + 3] * 4), _mm_load_ps(afPosition + auiNode0[uiArc + 3] * 4));
+		_MM_TRANSPOSE4_PS(vX, vY, vZ, vW);
+
+		__m128 vDistance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vX, vX), _mm_mul_ps(vY, vY)), _mm_mul_ps(vZ, vZ)));
+		__m128 vScale = _mm_div_ps(_mm_mul_ps(_mm_sub_ps(vDistance, _mm_loadu_ps(pTopology->m_afArcIdealLen + uiArc)), _mm_loadu_ps(pTopology->m_afArcSpringCoef + uiArc)), vDistance);
+		vScale = _mm_and_ps(vScale, _mm_cmpgt_ps(vDistance, vZero));
+
+		// back to one force vector per arc, w is zero
+		vX = _mm_mul_ps(vX, vScale);
+		vY = _mm_mul_ps(vY, vScale);
+		vZ = _mm_mul_ps(vZ, vScale);
+		vW = vZero;
+		_MM_TRANSPOSE4_PS(vX, vY, vZ, vW);
+
+		__m128 avForce[4] = { vX, vY, vZ, vW };
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			float *pfForce0 = afForce + auiNode0[uiArc + i] * 4;
+			float *pfForce1 = afForce + auiNode1[uiArc + i] * 4;
+			_mm_store_ps(pfForce0, _mm_add_ps(_mm_load_ps(pfForce0), avForce[i]));
+			_mm_store_ps(pfForce1, _mm_sub_ps(_mm_load_ps(pfForce1), avForce[i]));
+		}
+	}
+
+	solverArcForceScalar(pTopology, afPosition, afForce, uiArc, uiEnd);
+}
+
+static void solverIntegrateSSE(const raaSolver* pSolver, raaNodeStore* pStore, unsigned int uiBegin, unsigned int uiEnd)
+{
+	__m128 vTimeStep = _mm_set1_ps(pSolver->m_fTimeStep);
+	__m128 vDamping = _mm_set1_ps(1.0f - pSolver->m_fDamping);
+	__m128 vXYZ = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+
+	for (unsigned int i = uiBegin; i < uiEnd; i++)
+	{
+		float *pfPosition = pStore->m_afPosition + i * 4;
+		float *pfVelocity = pStore->m_afVelocity + i * 4;
+		__m128 vVelocity = _mm_load_ps(pfVelocity);
+		__m128 vNew = _mm_mul_ps(_mm_mul_ps(_mm_add_ps(vVelocity, _mm_mul_ps(_mm_load_ps(pStore->m_afForce + i * 4), _mm_set1_ps(pStore->m_afInvMass[i]))), vTimeStep), vDamping);
+
+		// w of velocity and position is left untouched
+		vNew = _mm_or_ps(_mm_and_ps(vXYZ, vNew), _mm_andnot_ps(vXYZ, vVelocity));
+		_mm_store_ps(pfVelocity, vNew);
+		_mm_store_ps(pfPosition, _mm_add_ps(_mm_load_ps(pfPosition), _mm_and_ps(vXYZ, _mm_div_ps(vNew, vTimeStep))));
+	}
+}
+
+RAA_TARGET_AVX2 static void solverArcForceAVX2(const raaTopology* pTopology, const float* afPosition, float* afForce, unsigned int uiBegin, unsigned int uiEnd)
+{
+	const unsigned int *auiNode0 = pTopology->m_auiArcNode0;
+	const unsigned int *auiNode1 = pTopology->m_auiArcNode1;
+	__m256 vZero = _mm256_setzero_ps();
+	alignas(32) float afX[8], afY[8], afZ[8];
+	unsigned int uiArc = uiBegin;
+
+	for (; uiArc + 8 <= uiEnd; uiArc += 8)
+	{
+		__m256i viNode0 = _mm256_slli_epi32(_mm256_loadu_si256((const __m256i*)(auiNode0 + uiArc)), 2);
+		__m256i viNode1 = _mm256_slli_epi32(_mm256_loadu_si256((const __m256i*)(auiNode1 + uiArc)), 2);
+
+		__m256 vX = _mm256_sub_ps(_mm256_i32gather_ps(afPosition, viNode1, 4), _mm256_i32gather_ps(afPosition, viNode0, 4));
+		__m256 vY = _mm256_sub_ps(_mm256_i32gather_ps(afPosition + 1, viNode1, 4), _mm256_i32gather_ps(afPosition + 1, viNode0, 4));
+		__m256 vZ = _mm256_sub_ps(_mm256_i32gather_ps(afPosition + 2, viNode1, 4), _mm256_i32gather_ps(afPosition + 2, viNode0, 4));
+
+		__m256 vDistance = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vX, vX), _mm256_mul_ps(vY, vY)), _mm256_mul_ps(vZ, vZ)));
+		__m256 vScale = _mm256_div_ps(_mm256_mul_ps(_mm256_sub_ps(vDistance, _mm256_loadu_ps(pTopology->m_afArcIdealLen + uiArc)), _mm256_loadu_ps(pTopology->m_afArcSpringCoef + uiArc)), vDistance);
+		vScale = _mm256_and_ps(vScale, _mm256_cmp_ps(vDistance, vZero, _CMP_GT_OQ));
+
+		_mm256_store_ps(afX, _mm256_mul_ps(vX, vScale));
+		_mm256_store_ps(afY, _mm256_mul_ps(vY, vScale));
+		_mm256_store_ps(afZ, _mm256_mul_ps(vZ, vScale));
+
+		// arcs in a block may share nodes so the forces are scattered one arc at a time
+		for (unsigned int i = 0; i < 8; i++)
+		{
+			float *pfForce0 = afForce + auiNode0[uiArc + i] * 4;
+			float *pfForce1 = afForce + auiNode1[uiArc + i] * 4;
+			pfForce0[0] += afX[i]; pfForce0[1] += afY[i]; pfForce0[2] += afZ[i];
+			pfForce1[0] -= afX[i]; pfForce1[1] -= afY[i]; pfForce1[2] -= afZ[i];
+		}
+	}
+
+	solverArcForceScalar(pTopology, afPosition, afForce, uiArc, uiEnd);
+}
+
+RAA_TARGET_AVX2 static void solverIntegrateAVX2(const raaSolver* pSolver, raaNodeStore* pStore, unsigned int uiBegin, unsigned int uiEnd)
+{
+	__m256 vTimeStep = _mm256_set1_ps(pSolver->m_fTimeStep);
+	__m256 vDamping = _mm256_set1_ps(1.0f - pSolver->m_fDamping);
+	unsigned int i = uiBegin;
+
+	for (; i + 2 <= uiEnd; i += 2)
+	{
+		float *pfPosition = pStore->m_afPosition + i * 4;
+		float *pfVelocity = pStore->m_afVelocity + i * 4;
+		__m256 vInvMass = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(pStore->m_afInvMass[i])), _mm_set1_ps(pStore->m_afInvMass[i + 1]), 1);
+		__m256 vVelocity = _mm256_loadu_ps(pfVelocity);
+		__m256 vNew = _mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(vVelocity, _mm256_mul_ps(_mm256_loadu_ps(pStore->m_afForce + i * 4), vInvMass)), vTimeStep), vDamping);
+
+		vNew = _mm256_blend_ps(vVelocity, vNew, 0x77);
+		_mm256_storeu_ps(pfVelocity, vNew);
+		_mm256_storeu_ps(pfPosition, _mm256_add_ps(_mm256_loadu_ps(pfPosition), _mm256_blend_ps(_mm256_setzero_ps(), _mm256_div_ps(vNew, vTimeStep), 0x77)));
+	}
+
+	solverIntegrateSSE(pSolver, pStore, i, uiEnd);
+}
+
+RAA_TARGET_AVX512 static void solverArcForceAVX512(const raaTopology* pTopology, const float* afPosition, float* afForce, unsigned int uiBegin, unsigned int uiEnd)
+{
+	const unsigned int *auiNode0 = pTopology->m_auiArcNode0;
+	const unsigned int *auiNode1 = pTopology->m_auiArcNode1;
+	__m512 vZero = _mm512_setzero_ps();
+	const __mmask16 uiAll = 0xffff;
+	alignas(64) float afX[16], afY[16], afZ[16];
+	unsigned int uiArc = uiBegin;
+
+	for (; uiArc + 16 <= uiEnd; uiArc += 16)
+	{
+		// the full mask zeroing forms throughout, the plain forms pass an undefined source vector to the builtins
+		__m512i viNode0 = _mm512_maskz_slli_epi32(uiAll, _mm512_loadu_si512(auiNode0 + uiArc), 2);
+		__m512i viNode1 = _mm512_maskz_slli_epi32(uiAll, _mm512_loadu_si512(auiNode1 + uiArc), 2);
+
+		__m512 vX = _mm512_sub_ps(_mm512_mask_i32gather_ps(vZero, uiAll, viNode1, afPosition, 4), _mm512_mask_i32gather_ps(vZero, uiAll, viNode0, afPosition, 4));
+		__m512 vY = _mm512_sub_ps(_mm512_mask_i32gather_ps(vZero, uiAll, viNode1, afPosition + 1, 4), _mm512_mask_i32gather_ps(vZero, uiAll, viNode0, afPosition + 1, 4));
+		__m512 vZ = _mm512_sub_ps(_mm512_mask_i32gather_ps(vZero, uiAll, viNode1, afPosition + 2, 4), _mm512_mask_i32gather_ps(vZero, uiAll, viNode0, afPosition + 2, 4));
+
+		__m512 vDistance = _mm512_maskz_sqrt_ps(uiAll, _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(vX, vX), _mm512_mul_ps(vY, vY)), _mm512_mul_ps(vZ, vZ)));
+		__m512 vScale = _mm512_div_ps(_mm512_mul_ps(_mm512_sub_ps(vDistance, _mm512_loadu_ps(pTopology->m_afArcIdealLen + uiArc)), _mm512_loadu_ps(pTopology->m_afArcSpringCoef + uiArc)), vDistance);
+		vScale = _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(vDistance, vZero, _CMP_GT_OQ), vScale);
+
+		_mm512_store_ps(afX, _mm512_mul_ps(vX, vScale));
+		_mm512_store_ps(afY, _mm512_mul_ps(vY, vScale));
+		_mm512_store_ps(afZ, _mm512_mul_ps(vZ, vScale));
+
+		for (unsigned int i = 0; i < 16; i++)
+		{
+			float *pfForce0 = afForce + auiNode0[uiArc + i] * 4;
+			float *pfForce1 = afForce + auiNode1[uiArc + i] * 4;
+			pfForce0[0] += afX[i]; pfForce0[1] += afY[i]; pfForce0[2] += afZ[i];
+			pfForce1[0] -= afX[i]; pfForce1[1] -= afY[i]; pfForce1[2] -= afZ[i];
+		}
+	}
+
+	solverArcForceScalar(pTopology, afPosition, afForce, uiArc, uiEnd);
+}
+
+RAA_TARGET_AVX512 static void solverIntegrateAVX512(const raaSolver* pSolver, raaNodeStore* pStore, unsigned int uiBegin, unsigned int uiEnd)
+{
+	__m512 vTimeStep = _mm512_set1_ps(pSolver->m_fTimeStep);
+	__m512 vDamping = _mm512_set1_ps(1.0f - pSolver->m_fDamping);
+	__m512i viSpread = _mm512_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3);
+	const __mmask16 uiXYZ = 0x7777;
+	unsigned int i = uiBegin;
+
+	for (; i + 4 <= uiEnd; i += 4)
+	{
+		float *pfPosition = pStore->m_afPosition + i * 4;
+		float *pfVelocity = pStore->m_afVelocity + i * 4;
+		__m512 vInvMass = _mm512_maskz_permutexvar_ps(0xffff, viSpread, _mm512_zextps128_ps512(_mm_loadu_ps(pStore->m_afInvMass + i)));
+		__m512 vVelocity = _mm512_loadu_ps(pfVelocity);
+		__m512 vNew = _mm512_mul_ps(_mm512_mul_ps(_mm512_add_ps(vVelocity, _mm512_mul_ps(_mm512_loadu_ps(pStore->m_afForce + i * 4), vInvMass)), vTimeStep), vDamping);
+
+		vNew = _mm512_mask_mov_ps(vVelocity, uiXYZ, vNew);
+		_mm512_storeu_ps(pfVelocity, vNew);
+		__m512 vPosition = _mm512_loadu_ps(pfPosition);
+		_mm512_storeu_ps(pfPosition, _mm512_mask_add_ps(vPosition, uiXYZ, vPosition, _mm512_div_ps(vNew, vTimeStep)));
+	}
+
+	solverIntegrateSSE(pSolver, pStore, i, uiEnd);
+}
+
+static unsigned int solverDetectKernel()
+{
+#if defined(_MSC_VER)
+	int aiInfo[4];
+	__cpuid(aiInfo, 0);
+	int iLeaves = aiInfo[0];
+
+	__cpuid(aiInfo, 1);
+	bool bOSXSave = (aiInfo[2] & (1 << 27)) != 0;
+	bool bAVX = (aiInfo[2] & (1 << 28)) != 0;
+	unsigned long long ulXCR0 = bOSXSave ? _xgetbv(0) : 0;
+
+	if (iLeaves >= 7 && bAVX && (ulXCR0 & 0x6) == 0x6)
+	{
+		__cpuidex(aiInfo, 7, 0);
+		if ((aiInfo[1] & (1 << 16)) && (ulXCR0 & 0xe6) == 0xe6) return csg_uiSolverKernelAVX512;
+		if (aiInfo[1] & (1 << 5)) return csg_uiSolverKernelAVX2;
+	}
+	return csg_uiSolverKernelSSE;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) return csg_uiSolverKernelAVX512;
+	if (__builtin_cpu_supports("avx2")) return csg_uiSolverKernelAVX2;
+	return csg_uiSolverKernelSSE;
+#endif
+}
+
+#endif
+
+unsigned int solverKernelSupported()
+{
+#ifdef RAA_SOLVER_X86
+	static unsigned int s_uiKernel = solverDetectKernel();
+	return s_uiKernel;
+#else
+	return csg_uiSolverKernelScalar;
+#endif
+}
+
+raaArcKernel* solverArcKernel(unsigned int uiKernel)
+{
+	switch (uiKernel)
+	{
+#ifdef RAA_SOLVER_X86
+	case csg_uiSolverKernelSSE:
+		return solverArcForceSSE;
+	case csg_uiSolverKernelAVX2:
+		return solverArcForceAVX2;
+	case csg_uiSolverKernelAVX512:
+		return solverArcForceAVX512;
+#endif
+	default:
+		return solverArcForceScalar;
+	}
+}
+
+raaIntegrateKernel* solverIntegrateKernel(unsigned int uiKernel)
+{
+	switch (uiKernel)
+	{
+#ifdef RAA_SOLVER_X86
+	case csg_uiSolverKernelSSE:
+		return solverIntegrateSSE;
+	case csg_uiSolverKernelAVX2:
+		return solverIntegrateAVX2;
+	case csg_uiSolverKernelAVX512:
+		return solverIntegrateAVX512;
+#endif
+	default:
+		return solverIntegrateScalar;
+	}
+}
@@ -1,33 +1,429 @@
 #include "stdafx.h"
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
 #include "raaSystem.h"
 #include <streambuf>
 
-void initSystem(raaSystem* pSystem)
+static float* storeGrowArray(float *pOld, unsigned int uiCount, unsigned int uiCapacity, unsigned int uiWidth)
+{
+	float *pNew = (float*)systemAlignedAlloc(sizeof(float)*uiWidth*uiCapacity);
+	if (pOld)
+	{
+		memcpy(pNew, pOld, sizeof(float)*uiWidth*uiCount);
+		systemAlignedFree(pOld);
+	}
+	return pNew;
+}
+
+static void storeReserve(raaNodeStore *pStore, unsigned int uiCapacity)
+{
+	if (pStore && uiCapacity > pStore->m_uiCapacity)
+	{
+		pStore->m_afPosition = storeGrowArray(pStore->m_afPosition, pStore->m_uiCount, uiCapacity, 4);
+		pStore->m_afVelocity = storeGrowArray(pStore->m_afVelocity, pStore->m_uiCount, uiCapacity, 4);
+		pStore->m_afForce = storeGrowArray(pStore->m_afForce, pStore->m_uiCount, uiCapacity, 4);
+		pStore->m_afInvMass = storeGrowArray(pStore->m_afInvMass, pStore->m_uiCount, uiCapacity, 1);
+
+		raaNode **apNode = new raaNode*[uiCapacity];
+		if (pStore->m_apNode)
+		{
+			memcpy(apNode, pStore->m_apNode, sizeof(raaNode*)*pStore->m_uiCount);
+			delete[] pStore->m_apNode;
+		}
+		pStore->m_apNode = apNode;
+		pStore->m_uiCapacity = uiCapacity;
+	}
+}
+
+static void idIndexResize(raaNodeIdIndex *pIndex, unsigned int uiSize)
+{
+	if (pIndex && uiSize > pIndex->m_uiDirectSize)
+	{
+		raaNode **apDirect = new raaNode*[uiSize];
+		memset(apDirect, 0, sizeof(raaNode*)*uiSize);
+		if (pIndex->m_apDirect)
+		{
+			memcpy(apDirect, pIndex->m_apDirect, sizeof(raaNode*)*pIndex->m_uiDirectSize);
+			delete[] pIndex->m_apDirect;
+		}
+		pIndex->m_apDirect = apDirect;
+		pIndex->m_uiDirectSize = uiSize;
+
+		// hashed ids now inside the direct range have to move or they would be shadowed by the empty direct slot
+		if (pIndex->m_pSparse)
+		{
+			for (std::unordered_map<unsigned int, raaNode*>::iterator it = pIndex->m_pSparse->begin(); it != pIndex->m_pSparse->end();)
+			{
+				if (it->first < uiSize)
+				{
+					apDirect[it->first] = it->second;
+					it = pIndex->m_pSparse->erase(it);
+				}
+				else it++;
+			}
+		}
+	}
+}
+
+static void idIndexInsert(raaSystem *pSystem, raaNode *pNode)
+{
+	raaNodeIdIndex *pIndex = &(pSystem->m_IdIndex);
+	unsigned int uiId = pNode->m_uiId;
+
+	if (uiId >= pIndex->m_uiDirectSize && uiId < pSystem->m_Nodes.m_uiCount * 2 + csg_uiNodeIdDirectSlack)
+	{
+		unsigned int uiSize = pIndex->m_uiDirectSize ? pIndex->m_uiDirectSize : csg_uiNodeIdDirectSlack;
+		while (uiSize <= uiId) uiSize *= 2;
+		idIndexResize(pIndex, uiSize);
+	}
+
+	if (uiId < pIndex->m_uiDirectSize) pIndex->m_apDirect[uiId] = pNode;
+	else
+	{
+		if (!pIndex->m_pSparse) pIndex->m_pSparse = new std::unordered_map<unsigned int, raaNode*>();
+		(*pIndex->m_pSparse)[uiId] = pNode;
+	}
+}
+
+static void idIndexClear(raaNodeIdIndex *pIndex)
+{
+	delete[] pIndex->m_apDirect;
+	delete pIndex->m_pSparse;
+	pIndex->m_apDirect = 0;
+	pIndex->m_uiDirectSize = 0;
+	pIndex->m_pSparse = 0;
+}
+
+static void topologyClear(raaTopology *pTopology)
+{
+	systemAlignedFree(pTopology->m_auiArcNode0);
+	systemAlignedFree(pTopology->m_auiArcNode1);
+	systemAlignedFree(pTopology->m_afArcSpringCoef);
+	systemAlignedFree(pTopology->m_afArcIdealLen);
+	delete[] pTopology->m_apArc;
+	systemAlignedFree(pTopology->m_auiOffset);
+	systemAlignedFree(pTopology->m_auiNeighbour);
+	systemAlignedFree(pTopology->m_auiNeighbourArc);
+	systemAlignedFree(pTopology->m_afSpringCoef);
+	systemAlignedFree(pTopology->m_afIdealLen);
+	memset(pTopology, 0, sizeof(raaTopology));
+}
+
+static raaHandle handleAlloc(raaHandleTable *pTable, void *pItem)
+{
+	raaHandle h;
+
+	if (pTable->m_uiFree != csg_uiInvalidIndex)
+	{
+		h.m_uiSlot = pTable->m_uiFree;
+		pTable->m_uiFree = pTable->m_auiNextFree[h.m_uiSlot];
+	}
+	else
+	{
+		if (pTable->m_uiCount == pTable->m_uiCapacity)
+		{
+			unsigned int uiCapacity = pTable->m_uiCapacity ? pTable->m_uiCapacity * 2 : csg_uiNodeStoreMinCapacity;
+			void **apItem = new void*[uiCapacity];
+			unsigned int *auiGeneration = new unsigned int[uiCapacity];
+			unsigned int *auiNextFree = new unsigned int[uiCapacity];
+
+			if (pTable->m_uiCount)
+			{
+				memcpy(apItem, pTable->m_apItem, sizeof(void*)*pTable->m_uiCount);
+				memcpy(auiGeneration, pTable->m_auiGeneration, sizeof(unsigned int)*pTable->m_uiCount);
+				memcpy(auiNextFree, pTable->m_auiNextFree, sizeof(unsigned int)*pTable->m_uiCount);
+			}
+			delete[] pTable->m_apItem;
+			delete[] pTable->m_auiGeneration;
+			delete[] pTable->m_auiNextFree;
+
+			pTable->m_apItem = apItem;
+			pTable->m_auiGeneration = auiGeneration;
+			pTable->m_auiNextFree = auiNextFree;
+			pTable->m_uiCapacity = uiCapacity;
+		}
+		h.m_uiSlot = pTable->m_uiCount++;
+		pTable->m_auiGeneration[h.m_uiSlot] = 1;
+	}
+
+	pTable->m_apItem[h.m_uiSlot] = pItem;
+	h.m_uiGeneration = pTable->m_auiGeneration[h.m_uiSlot];
+	return h;
+}
+
+static void* handleGet(raaHandleTable *pTable, raaHandle h)
+{
+	return h.m_uiSlot < pTable->m_uiCount && pTable->m_auiGeneration[h.m_uiSlot] == h.m_uiGeneration ? pTable->m_apItem[h.m_uiSlot] : 0;
+}
+
+static void handleRelease(raaHandleTable *pTable, raaHandle h)
+{
+	if (handleGet(pTable, h))
+	{
+		pTable->m_apItem[h.m_uiSlot] = 0;
+		if (!++pTable->m_auiGeneration[h.m_uiSlot]) pTable->m_auiGeneration[h.m_uiSlot] = 1;
+		pTable->m_auiNextFree[h.m_uiSlot] = pTable->m_uiFree;
+		pTable->m_uiFree = h.m_uiSlot;
+	}
+}
+
+static void handleClear(raaHandleTable *pTable, bool bKeep)
+{
+	if (!bKeep)
+	{
+		delete[] pTable->m_apItem;
+		delete[] pTable->m_auiGeneration;
+		delete[] pTable->m_auiNextFree;
+		memset(pTable, 0, sizeof(raaHandleTable));
+	}
+	else
+	{
+		// generations survive so handles from before the reset stay invalid
+		for (unsigned int i = 0; i < pTable->m_uiCount; i++)
+		{
+			if (pTable->m_apItem[i] && !++pTable->m_auiGeneration[i]) pTable->m_auiGeneration[i] = 1;
+			pTable->m_apItem[i] = 0;
+			pTable->m_auiNextFree[i] = i + 1 < pTable->m_uiCount ? i + 1 : csg_uiInvalidIndex;
+		}
+		pTable->m_uiFree = pTable->m_uiCount ? 0 : csg_uiInvalidIndex;
+		return;
+	}
+	pTable->m_uiFree = csg_uiInvalidIndex;
+}
+
+static unsigned int arcChainSlot(raaArc *pArc, raaNode *pNode)
+{
+	return pArc->m_pNode0 == pNode ? 0 : 1;
+}
+
+static void arcChainLink(raaArc *pArc, unsigned int uiSlot)
+{
+	raaNode *pNode = uiSlot ? pArc->m_pNode1 : pArc->m_pNode0;
+
+	pArc->m_apLastArc[uiSlot] = 0;
+	pArc->m_apNextArc[uiSlot] = pNode->m_pArcs;
+	if (pNode->m_pArcs) pNode->m_pArcs->m_apLastArc[arcChainSlot(pNode->m_pArcs, pNode)] = pArc;
+	pNode->m_pArcs = pArc;
+}
+
+static void arcChainUnlink(raaArc *pArc, unsigned int uiSlot)
+{
+	raaNode *pNode = uiSlot ? pArc->m_pNode1 : pArc->m_pNode0;
+	raaArc *pNext = pArc->m_apNextArc[uiSlot];
+	raaArc *pLast = pArc->m_apLastArc[uiSlot];
+
+	if (pLast) pLast->m_apNextArc[arcChainSlot(pLast, pNode)] = pNext;
+	else pNode->m_pArcs = pNext;
+	if (pNext) pNext->m_apLastArc[arcChainSlot(pNext, pNode)] = pLast;
+
+	pArc->m_apNextArc[uiSlot] = pArc->m_apLastArc[uiSlot] = 0;
+}
+
+static raaArc* arcChainNext(raaArc *pArc, raaNode *pNode)
+{
+	return pArc->m_apNextArc[arcChainSlot(pArc, pNode)];
+}
+
+static void topologyReserveArcs(raaTopology *pTopology, unsigned int uiCapacity)
+{
+	if (uiCapacity > pTopology->m_uiArcCapacity)
+	{
+		unsigned int uiCount = pTopology->m_uiArcCount;
+		pTopology->m_auiArcNode0 = (unsigned int*)storeGrowArray((float*)pTopology->m_auiArcNode0, uiCount, uiCapacity, 1);
+		pTopology->m_auiArcNode1 = (unsigned int*)storeGrowArray((float*)pTopology->m_auiArcNode1, uiCount, uiCapacity, 1);
+		pTopology->m_afArcSpringCoef = storeGrowArray(pTopology->m_afArcSpringCoef, uiCount, uiCapacity, 1);
+		pTopology->m_afArcIdealLen = storeGrowArray(pTopology->m_afArcIdealLen, uiCount, uiCapacity, 1);
+
+		raaArc **apArc = new raaArc*[uiCapacity];
+		if (pTopology->m_apArc)
+		{
+			memcpy(apArc, pTopology->m_apArc, sizeof(raaArc*)*uiCount);
+			delete[] pTopology->m_apArc;
+		}
+		pTopology->m_apArc = apArc;
+		pTopology->m_uiArcCapacity = uiCapacity;
+	}
+}
+
+static void topologyClearAdjacency(raaTopology *pTopology)
+{
+	systemAlignedFree(pTopology->m_auiOffset);
+	systemAlignedFree(pTopology->m_auiNeighbour);
+	systemAlignedFree(pTopology->m_auiNeighbourArc);
+	systemAlignedFree(pTopology->m_afSpringCoef);
+	systemAlignedFree(pTopology->m_afIdealLen);
+	pTopology->m_auiOffset = pTopology->m_auiNeighbour = pTopology->m_auiNeighbourArc = 0;
+	pTopology->m_afSpringCoef = pTopology->m_afIdealLen = 0;
+	pTopology->m_bAdjacencyValid = false;
+}
+
+static void topologyBuildAdjacency(raaTopology *pTopology, unsigned int uiNodes)
+{
+	unsigned int uiArcs = pTopology->m_uiArcCount;
+
+	topologyClearAdjacency(pTopology);
+
+	pTopology->m_uiNodeCount = uiNodes;
+	pTopology->m_auiOffset = (unsigned int*)systemAlignedAlloc(sizeof(unsigned int)*(uiNodes + 1));
+	pTopology->m_auiNeighbour = (unsigned int*)systemAlignedAlloc(sizeof(unsigned int)*uiArcs * 2);
+	pTopology->m_auiNeighbourArc = (unsigned int*)systemAlignedAlloc(sizeof(unsigned int)*uiArcs * 2);
+	pTopology->m_afSpringCoef = (float*)systemAlignedAlloc(sizeof(float)*uiArcs * 2);
+	pTopology->m_afIdealLen = (float*)systemAlignedAlloc(sizeof(float)*uiArcs * 2);
+
+	// count the degree of each node into the row offsets, prefix sum them, then scatter each arc into both rows
+	memset(pTopology->m_auiOffset, 0, sizeof(unsigned int)*(uiNodes + 1));
+	for (unsigned int i = 0; i < uiArcs; i++)
+	{
+		pTopology->m_auiOffset[pTopology->m_auiArcNode0[i] + 1]++;
+		pTopology->m_auiOffset[pTopology->m_auiArcNode1[i] + 1]++;
+	}
+	for (unsigned int i = 0; i < uiNodes; i++) pTopology->m_auiOffset[i + 1] += pTopology->m_auiOffset[i];
+
+	unsigned int *auiFill = new unsigned int[uiNodes ? uiNodes : 1];
+	memcpy(auiFill, pTopology->m_auiOffset, sizeof(unsigned int)*uiNodes);
+	for (unsigned int i = 0; i < uiArcs; i++)
+	{
+		unsigned int uiNode0 = pTopology->m_auiArcNode0[i];
+		unsigned int uiNode1 = pTopology->m_auiArcNode1[i];
+		unsigned int uiSlot0 = auiFill[uiNode0]++;
+		unsigned int uiSlot1 = auiFill[uiNode1]++;
+
+		pTopology->m_auiNeighbour[uiSlot0] = uiNode1;
+		pTopology->m_auiNeighbourArc[uiSlot0] = i;
+		pTopology->m_afSpringCoef[uiSlot0] = pTopology->m_afArcSpringCoef[i];
+		pTopology->m_afIdealLen[uiSlot0] = pTopology->m_afArcIdealLen[i];
+
+		pTopology->m_auiNeighbour[uiSlot1] = uiNode0;
+		pTopology->m_auiNeighbourArc[uiSlot1] = i;
+		pTopology->m_afSpringCoef[uiSlot1] = pTopology->m_afArcSpringCoef[i];
+		pTopology->m_afIdealLen[uiSlot1] = pTopology->m_afArcIdealLen[i];
+	}
+	delete[] auiFill;
+
+	pTopology->m_bAdjacencyValid = true;
+}
+
+static bool topologyAdjacency(raaSystem *pSystem)
+{
+	if (!pSystem->m_Topology.m_bValid) buildTopology(pSystem);
+	else if (!pSystem->m_Topology.m_bAdjacencyValid) topologyBuildAdjacency(&(pSystem->m_Topology), pSystem->m_Nodes.m_uiCount);
+	return pSystem->m_Topology.m_bAdjacencyValid;
+}
+
+void* systemAlignedAlloc(size_t uiSize)
+{
+#ifdef _WIN32
+	return _aligned_malloc(uiSize ? uiSize : csg_uiSystemAlignment, csg_uiSystemAlignment);
+#else
+	void *pMem = 0;
+	if (posix_memalign(&pMem, csg_uiSystemAlignment, uiSize ? uiSize : csg_uiSystemAlignment)) pMem = 0;
+	return pMem;
+#endif
+}
+
+void systemAlignedFree(void* pMem)
+{
+#ifdef _WIN32
+	if (pMem) _aligned_free(pMem);
+#else
+	free(pMem);
+#endif
+}
+
+void initSystem(raaSystem* pSystem, bool bNodeList)
 {
 	if(pSystem)
 	{
-		initList(&(pSystem->m_llArcs), csg_uiArc);
-		initList(&(pSystem->m_llNodes), csg_uiNode);
+		initList(&(pSystem->m_llArcs), csg_uiArc, true);
+		initList(&(pSystem->m_llNodes), csg_uiNode, true);
+		memset(&(pSystem->m_Nodes), 0, sizeof(raaNodeStore));
+		memset(&(pSystem->m_IdIndex), 0, sizeof(raaNodeIdIndex));
+		memset(&(pSystem->m_Topology), 0, sizeof(raaTopology));
+		poolInit(&(pSystem->m_NodePool), sizeof(raaNode));
+		poolInit(&(pSystem->m_ArcPool), sizeof(raaArc));
+		poolInit(&(pSystem->m_ElementPool), sizeof(raaLinkedListElement));
+		nameTableInit(&(pSystem->m_Names));
+		memset(&(pSystem->m_NodeHandles), 0, sizeof(raaHandleTable));
+		memset(&(pSystem->m_ArcHandles), 0, sizeof(raaHandleTable));
+		pSystem->m_NodeHandles.m_uiFree = pSystem->m_ArcHandles.m_uiFree = csg_uiInvalidIndex;
+		pSystem->m_bNodeList = bNodeList;
 	}
 }
 
-raaNode* initNode(raaNode* pNode, unsigned int uiId, float* pfPosition, float fMass, const char* acName)
+void destroySystem(raaSystem* pSystem)
+{
+	if (pSystem)
+	{
+		// list elements, and any nodes and arcs from allocNode/allocArc, live in the pools so the lists are simply dropped
+		clearList(&(pSystem->m_llArcs));
+		clearList(&(pSystem->m_llNodes));
+		poolReset(&(pSystem->m_NodePool));
+		poolReset(&(pSystem->m_ArcPool));
+		poolReset(&(pSystem->m_ElementPool));
+		nameTableDestroy(&(pSystem->m_Names));
+
+		raaNodeStore *pStore = &(pSystem->m_Nodes);
+		systemAlignedFree(pStore->m_afPosition);
+		systemAlignedFree(pStore->m_afVelocity);
+		systemAlignedFree(pStore->m_afForce);
+		systemAlignedFree(pStore->m_afInvMass);
+		delete[] pStore->m_apNode;
+		memset(pStore, 0, sizeof(raaNodeStore));
+
+		idIndexClear(&(pSystem->m_IdIndex));
+		topologyClear(&(pSystem->m_Topology));
+		handleClear(&(pSystem->m_NodeHandles), false);
+		handleClear(&(pSystem->m_ArcHandles), false);
+	}
+}
+
+void resetSystem(raaSystem* pSystem)
+{
+	if (pSystem)
+	{
+		clearList(&(pSystem->m_llArcs));
+		clearList(&(pSystem->m_llNodes));
+		poolReset(&(pSystem->m_NodePool), true);
+		poolReset(&(pSystem->m_ArcPool), true);
+		poolReset(&(pSystem->m_ElementPool), true);
+		nameTableReset(&(pSystem->m_Names));
+
+		pSystem->m_Nodes.m_uiCount = 0;
+		idIndexClear(&(pSystem->m_IdIndex));
+		topologyClear(&(pSystem->m_Topology));
+		handleClear(&(pSystem->m_NodeHandles), true);
+		handleClear(&(pSystem->m_ArcHandles), true);
+	}
+}
+
+raaNode* allocNode(raaSystem* pSystem)
+{
+	return pSystem ? (raaNode*)poolAlloc(&(pSystem->m_NodePool)) : 0;
+}
+
+raaArc* allocArc(raaSystem* pSystem)
+{
+	return pSystem ? (raaArc*)poolAlloc(&(pSystem->m_ArcPool)) : 0;
+}
+
+raaNode* initNode(raaNode* pNode, unsigned int uiId, float* pfPosition, float fMass)
 {
 	if(pNode)
 	{
-		vecInitPVec(pNode->m_afPosition);
-		vecCopy(pfPosition, pNode->m_afPosition);
 		pNode->m_fMass = fMass;
-		sprintf_s(pNode->m_acName, "%s", acName);
+		pNode->m_uiName = 0;
 		pNode->m_uiId = uiId;
+		pNode->m_uiIndex = csg_uiInvalidIndex;
 		pNode->m_uiContinent = 0;
 		pNode->m_uiWorldSystem = 0;
-		vecInitPVec(pNode->m_resultantForce);
-		vecInitPVec(pNode->m_velocity);
 		vecInitPVec(pNode->m_defaultPosition);
 		vecInitPVec(pNode->m_worldSystemPosition);
 		vecCopy(pfPosition, pNode->m_defaultPosition);
+		pNode->m_Handle = csg_NullHandle;
+		pNode->m_pElement = 0;
+		pNode->m_pArcs = 0;
 	}
 
 	return pNode;
@@ -41,24 +437,113 @@ raaArc* initArc(raaArc* pArc, raaNode* pNode0, raaNode* pNode1, float fSpringCoe
 		pArc->m_pNode1 = pNode1;
 		pArc->m_fSpringCoef = fSpringCoef;
 		pArc->m_fIdealLen = fIdealLen;
+		pArc->m_uiIndex = csg_uiInvalidIndex;
+		pArc->m_Handle = csg_NullHandle;
+		pArc->m_pElement = 0;
+		pArc->m_apNextArc[0] = pArc->m_apNextArc[1] = 0;
+		pArc->m_apLastArc[0] = pArc->m_apLastArc[1] = 0;
 	}
 	return pArc;
 }
 
 void addNode(raaSystem* pSystem, raaNode* pNode)
 {
-	if(pSystem && pNode) pushTail(&(pSystem->m_llNodes), initElement(new raaLinkedListElement, pNode, csg_uiNode));
+	if(pSystem && pNode)
+	{
+		raaNodeStore *pStore = &(pSystem->m_Nodes);
+
+		if (pStore->m_uiCount == pStore->m_uiCapacity) storeReserve(pStore, pStore->m_uiCapacity ? pStore->m_uiCapacity * 2 : csg_uiNodeStoreMinCapacity);
+
+		unsigned int uiIndex = pStore->m_uiCount++;
+		pNode->m_uiIndex = uiIndex;
+		pStore->m_apNode[uiIndex] = pNode;
+		vecCopy(pNode->m_defaultPosition, pStore->m_afPosition + uiIndex * 4);
+		vecInitDVec(pStore->m_afVelocity + uiIndex * 4);
+		vecInitDVec(pStore->m_afForce + uiIndex * 4);
+		pStore->m_afInvMass[uiIndex] = pNode->m_fMass > 0.0f ? 1.0f / pNode->m_fMass : 0.0f;
+
+		idIndexInsert(pSystem, pNode);
+		pNode->m_Handle = handleAlloc(&(pSystem->m_NodeHandles), pNode);
+		pNode->m_pArcs = 0;
+		pSystem->m_Topology.m_bAdjacencyValid = false;
+
+		if (pSystem->m_bNodeList)
+		{
+			pNode->m_pElement = initElement((raaLinkedListElement*)poolAlloc(&(pSystem->m_ElementPool)), pNode, csg_uiNode);
+			pushTail(&(pSystem->m_llNodes), pNode->m_pElement);
+		}
+	}
+}
+
+void reserveNodes(raaSystem* pSystem, unsigned int uiCount)
+{
+	if (pSystem)
+	{
+		storeReserve(&(pSystem->m_Nodes), pSystem->m_Nodes.m_uiCount + uiCount);
+		idIndexResize(&(pSystem->m_IdIndex), pSystem->m_Nodes.m_uiCount + uiCount + 1);
+	}
+}
+
+void buildNodeIdIndex(raaSystem* pSystem)
+{
+	if (pSystem)
+	{
+		raaNodeStore *pStore = &(pSystem->m_Nodes);
+		unsigned int uiMaxId = 0;
+
+		idIndexClear(&(pSystem->m_IdIndex));
+		for (unsigned int i = 0; i < pStore->m_uiCount; i++) if (pStore->m_apNode[i]->m_uiId > uiMaxId) uiMaxId = pStore->m_apNode[i]->m_uiId;
+		idIndexResize(&(pSystem->m_IdIndex), uiMaxId < pStore->m_uiCount * 2 + csg_uiNodeIdDirectSlack ? uiMaxId + 1 : pStore->m_uiCount + 1);
+		for (unsigned int i = 0; i < pStore->m_uiCount; i++) idIndexInsert(pSystem, pStore->m_apNode[i]);
+	}
+}
+
+float* nodePosition(raaSystem* pSystem, raaNode* pNode)
+{
+	return (pSystem && pNode && pNode->m_uiIndex < pSystem->m_Nodes.m_uiCount) ? pSystem->m_Nodes.m_afPosition + pNode->m_uiIndex * 4 : 0;
+}
+
+float* nodeVelocity(raaSystem* pSystem, raaNode* pNode)
+{
+	return (pSystem && pNode && pNode->m_uiIndex < pSystem->m_Nodes.m_uiCount) ? pSystem->m_Nodes.m_afVelocity + pNode->m_uiIndex * 4 : 0;
+}
+
+float* nodeForce(raaSystem* pSystem, raaNode* pNode)
+{
+	return (pSystem && pNode && pNode->m_uiIndex < pSystem->m_Nodes.m_uiCount) ? pSystem->m_Nodes.m_afForce + pNode->m_uiIndex * 4 : 0;
+}
+
+void nodeSetMass(raaSystem* pSystem, raaNode* pNode, float fMass)
+{
+	if (pSystem && pNode)
+	{
+		pNode->m_fMass = fMass;
+		if (pNode->m_uiIndex < pSystem->m_Nodes.m_uiCount) pSystem->m_Nodes.m_afInvMass[pNode->m_uiIndex] = fMass > 0.0f ? 1.0f / fMass : 0.0f;
+	}
+}
+
+void nodeSetName(raaSystem* pSystem, raaNode* pNode, const char* acName)
+{
+	if (pSystem && pNode) pNode->m_uiName = nameTableIntern(&(pSystem->m_Names), acName);
+}
+
+const char* nodeName(raaSystem* pSystem, raaNode* pNode)
+{
+	return pSystem && pNode ? nameTableString(&(pSystem->m_Names), pNode->m_uiName) : "";
 }
 
 void visitArcs(raaSystem* pSystem, arcFunction* pArcFunction)
 {
 	if (pSystem && pArcFunction)
 	{
-		for (raaLinkedListElement *pE = pSystem->m_llArcs.m_pHead; pE; pE = pE->m_pNext)
+		raaLinkedList *pList = &(pSystem->m_llArcs);
+		for (unsigned int i = 0; i < pList->m_uiChunks; i++)
 		{
-			if (pE->m_uiType == csg_uiArc && pE->m_pData)
+			raaLinkedListChunk *pChunk = pList->m_apChunk[i];
+			for (unsigned int j = 0; j < pChunk->m_uiCount; j++)
 			{
-				pArcFunction((raaArc*)pE->m_pData);
+				raaLinkedListElement *pE = pChunk->m_apElement[j];
+				if (pE->m_uiType == csg_uiArc && pE->m_pData) pArcFunction((raaArc*)pE->m_pData);
 			}
 		}
 	}
@@ -68,25 +553,280 @@ void visitNodes(raaSystem* pSystem, nodeFunction* pNodeFunction)
 {
 	if(pSystem && pNodeFunction)
 	{
-		for(raaLinkedListElement *pE=pSystem->m_llNodes.m_pHead;pE;pE=pE->m_pNext)
+		raaNode **apNode = pSystem->m_Nodes.m_apNode;
+		for (unsigned int i = 0; i < pSystem->m_Nodes.m_uiCount; i++) pNodeFunction(apNode[i]);
+	}
+}
+
+raaNode* nodeById(raaSystem *pSystem, unsigned int uiId)
+{
+	if(pSystem && uiId)
+	{
+		raaNodeIdIndex *pIndex = &(pSystem->m_IdIndex);
+		if (uiId < pIndex->m_uiDirectSize) return pIndex->m_apDirect[uiId];
+		if (pIndex->m_pSparse)
+		{
+			std::unordered_map<unsigned int, raaNode*>::iterator it = pIndex->m_pSparse->find(uiId);
+			if (it != pIndex->m_pSparse->end()) return it->second;
+		}
+	}
+	return 0;
+}
+
+void addArc(raaSystem* pSystem, raaArc* pArc)
+{
+	if (pSystem && pArc)
+	{
+		raaTopology *pTopology = &(pSystem->m_Topology);
+
+		pArc->m_pElement = initElement((raaLinkedListElement*)poolAlloc(&(pSystem->m_ElementPool)), pArc, csg_uiArc);
+		pushTail(&(pSystem->m_llArcs), pArc->m_pElement);
+		pArc->m_Handle = handleAlloc(&(pSystem->m_ArcHandles), pArc);
+
+		arcChainLink(pArc, 0);
+		if (pArc->m_pNode1 != pArc->m_pNode0) arcChainLink(pArc, 1);
+
+		// a built topology is extended in place, only the adjacency has to be redone
+		if (pTopology->m_bValid)
+		{
+			if (pTopology->m_uiArcCount == pTopology->m_uiArcCapacity) topologyReserveArcs(pTopology, pTopology->m_uiArcCapacity ? pTopology->m_uiArcCapacity * 2 : csg_uiNodeStoreMinCapacity);
+
+			unsigned int uiArc = pTopology->m_uiArcCount++;
+			pArc->m_uiIndex = uiArc;
+			pTopology->m_apArc[uiArc] = pArc;
+			pTopology->m_auiArcNode0[uiArc] = pArc->m_pNode0->m_uiIndex;
+			pTopology->m_auiArcNode1[uiArc] = pArc->m_pNode1->m_uiIndex;
+			pTopology->m_afArcSpringCoef[uiArc] = pArc->m_fSpringCoef;
+			pTopology->m_afArcIdealLen[uiArc] = pArc->m_fIdealLen;
+		}
+		pTopology->m_bAdjacencyValid = false;
+	}
+}
+
+unsigned int mergeArcs(raaSystem* pSystem, unsigned int uiRule)
+{
+	unsigned int uiMerged = 0;
+
+	if (pSystem && pSystem->m_Nodes.m_uiCount)
+	{
+		unsigned int uiNodes = pSystem->m_Nodes.m_uiCount;
+		raaArc **apFirst = new raaArc*[uiNodes]; // first arc from the current node to each neighbour
+		unsigned int *auiParallel = new unsigned int[uiNodes];
+		unsigned int *auiMark = new unsigned int[uiNodes];
+		std::vector<raaArc*> vMerged;
+		std::vector<unsigned int> vGroups;
+
+		memset(auiMark, 0xff, sizeof(unsigned int)*uiNodes);
+
+		// each pair is handled from its lower indexed node, walking that node's arc chain
+		for (unsigned int i = 0; i < uiNodes; i++)
+		{
+			raaNode *pNode = pSystem->m_Nodes.m_apNode[i];
+			vMerged.clear();
+			vGroups.clear();
+
+			for (raaArc *pArc = pNode->m_pArcs; pArc; pArc = arcChainNext(pArc, pNode))
+			{
+				unsigned int j = (pArc->m_pNode0 == pNode ? pArc->m_pNode1 : pArc->m_pNode0)->m_uiIndex;
+
+				if (j < i) continue;
+
+				if (auiMark[j] != i)
+				{
+					auiMark[j] = i;
+					apFirst[j] = pArc;
+					auiParallel[j] = 1;
+				}
+				else
+				{
+					raaArc *pFirst = apFirst[j];
+
+					if (uiRule == csg_uiArcMergeMax) pFirst->m_fSpringCoef = pArc->m_fSpringCoef > pFirst->m_fSpringCoef ? pArc->m_fSpringCoef : pFirst->m_fSpringCoef;
+					else pFirst->m_fSpringCoef += pArc->m_fSpringCoef;
+					pFirst->m_fIdealLen += pArc->m_fIdealLen;
+
+					if (auiParallel[j]++ == 1) vGroups.push_back(j);
+					vMerged.push_back(pArc);
+				}
+			}
+
+			for (unsigned int k = 0; k < vMerged.size(); k++) removeArc(pSystem, vMerged[k]->m_Handle);
+
+			for (unsigned int k = 0; k < vGroups.size(); k++)
+			{
+				raaArc *pFirst = apFirst[vGroups[k]];
+				float fParallel = (float)auiParallel[vGroups[k]];
+
+				if (uiRule == csg_uiArcMergeMean) pFirst->m_fSpringCoef /= fParallel;
+				pFirst->m_fIdealLen /= fParallel;
+
+				if (pSystem->m_Topology.m_bValid)
+				{
+					pSystem->m_Topology.m_afArcSpringCoef[pFirst->m_uiIndex] = pFirst->m_fSpringCoef;
+					pSystem->m_Topology.m_afArcIdealLen[pFirst->m_uiIndex] = pFirst->m_fIdealLen;
+				}
+			}
+
+			uiMerged += (unsigned int)vMerged.size();
+		}
+
+		delete[] apFirst;
+		delete[] auiParallel;
+		delete[] auiMark;
+	}
+	return uiMerged;
+}
+
+raaNode* nodeFromHandle(raaSystem* pSystem, raaHandle hNode)
+{
+	return pSystem ? (raaNode*)handleGet(&(pSystem->m_NodeHandles), hNode) : 0;
+}
+
+raaArc* arcFromHandle(raaSystem* pSystem, raaHandle hArc)
+{
+	return pSystem ? (raaArc*)handleGet(&(pSystem->m_ArcHandles), hArc) : 0;
+}
+
+bool removeArc(raaSystem* pSystem, raaHandle hArc)
+{
+	raaArc *pArc = arcFromHandle(pSystem, hArc);
+
+	if (pArc)
+	{
+		raaTopology *pTopology = &(pSystem->m_Topology);
+
+		arcChainUnlink(pArc, 0);
+		if (pArc->m_pNode1 != pArc->m_pNode0) arcChainUnlink(pArc, 1);
+
+		// swap the last arc into the hole so the arc arrays stay dense
+		if (pTopology->m_bValid && pArc->m_uiIndex < pTopology->m_uiArcCount)
 		{
-			if(pE->m_uiType==csg_uiNode && pE->m_pData)
+			unsigned int uiHole = pArc->m_uiIndex;
+			unsigned int uiLast = --pTopology->m_uiArcCount;
+
+			if (uiHole != uiLast)
 			{
-				pNodeFunction((raaNode*)pE->m_pData);
+				pTopology->m_apArc[uiHole] = pTopology->m_apArc[uiLast];
+				pTopology->m_auiArcNode0[uiHole] = pTopology->m_auiArcNode0[uiLast];
+				pTopology->m_auiArcNode1[uiHole] = pTopology->m_auiArcNode1[uiLast];
+				pTopology->m_afArcSpringCoef[uiHole] = pTopology->m_afArcSpringCoef[uiLast];
+				pTopology->m_afArcIdealLen[uiHole] = pTopology->m_afArcIdealLen[uiLast];
+				pTopology->m_apArc[uiHole]->m_uiIndex = uiHole;
 			}
 		}
+		pTopology->m_bAdjacencyValid = false;
+
+		remove(&(pSystem->m_llArcs), pArc->m_pElement);
+		poolFree(&(pSystem->m_ElementPool), pArc->m_pElement);
+		handleRelease(&(pSystem->m_ArcHandles), hArc);
+		poolFree(&(pSystem->m_ArcPool), pArc);
+		return true;
 	}
+	return false;
 }
 
-raaNode* nodeById(raaSystem *pSystem, unsigned int uiId)
+bool removeNode(raaSystem* pSystem, raaHandle hNode)
 {
-	if(pSystem && uiId)
-		for(raaLinkedListElement *pE=pSystem->m_llNodes.m_pHead;pE;pE=pE->m_pNext)
-			if (pE->m_uiType == csg_uiNode && pE->m_pData && ((raaNode*)pE->m_pData)->m_uiId == uiId) return (raaNode*)pE->m_pData;
+	raaNode *pNode = nodeFromHandle(pSystem, hNode);
+
+	if (pNode)
+	{
+		raaNodeStore *pStore = &(pSystem->m_Nodes);
+		raaTopology *pTopology = &(pSystem->m_Topology);
+		raaNodeIdIndex *pIndex = &(pSystem->m_IdIndex);
+
+		while (pNode->m_pArcs) removeArc(pSystem, pNode->m_pArcs->m_Handle);
+
+		if (pNode->m_uiId < pIndex->m_uiDirectSize) { if (pIndex->m_apDirect[pNode->m_uiId] == pNode) pIndex->m_apDirect[pNode->m_uiId] = 0; }
+		else if (pIndex->m_pSparse && nodeById(pSystem, pNode->m_uiId) == pNode) pIndex->m_pSparse->erase(pNode->m_uiId);
+
+		// swap the last node into the hole so the store stays dense, its arcs are re-pointed at its new index
+		unsigned int uiHole = pNode->m_uiIndex;
+		unsigned int uiLast = --pStore->m_uiCount;
+		if (uiHole != uiLast)
+		{
+			raaNode *pMoved = pStore->m_apNode[uiLast];
+
+			memcpy(pStore->m_afPosition + uiHole * 4, pStore->m_afPosition + uiLast * 4, sizeof(float) * 4);
+			memcpy(pStore->m_afVelocity + uiHole * 4, pStore->m_afVelocity + uiLast * 4, sizeof(float) * 4);
+			memcpy(pStore->m_afForce + uiHole * 4, pStore->m_afForce + uiLast * 4, sizeof(float) * 4);
+			pStore->m_afInvMass[uiHole] = pStore->m_afInvMass[uiLast];
+			pStore->m_apNode[uiHole] = pMoved;
+			pMoved->m_uiIndex = uiHole;
+
+			if (pTopology->m_bValid)
+			{
+				for (raaArc *pArc = pMoved->m_pArcs; pArc; pArc = arcChainNext(pArc, pMoved))
+				{
+					if (pArc->m_pNode0 == pMoved) pTopology->m_auiArcNode0[pArc->m_uiIndex] = uiHole;
+					if (pArc->m_pNode1 == pMoved) pTopology->m_auiArcNode1[pArc->m_uiIndex] = uiHole;
+				}
+			}
+		}
+		pTopology->m_bAdjacencyValid = false;
+
+		if (pNode->m_pElement)
+		{
+			remove(&(pSystem->m_llNodes), pNode->m_pElement);
+			poolFree(&(pSystem->m_ElementPool), pNode->m_pElement);
+		}
+		handleRelease(&(pSystem->m_NodeHandles), hNode);
+		poolFree(&(pSystem->m_NodePool), pNode);
+		return true;
+	}
+	return false;
+}
+
+void buildTopology(raaSystem* pSystem)
+{
+	if (pSystem)
+	{
+		raaTopology *pTopology = &(pSystem->m_Topology);
+		unsigned int uiArcs = count(&(pSystem->m_llArcs));
+
+		topologyClear(pTopology);
+		topologyReserveArcs(pTopology, uiArcs ? uiArcs : 1);
+
+		unsigned int uiArc = 0;
+		for (raaLinkedListElement *pE = pSystem->m_llArcs.m_pHead; pE; pE = pE->m_pNext)
+		{
+			if (pE->m_pData)
+			{
+				raaArc *pArc = (raaArc*)pE->m_pData;
+				pArc->m_uiIndex = uiArc;
+				pTopology->m_apArc[uiArc] = pArc;
+				pTopology->m_auiArcNode0[uiArc] = pArc->m_pNode0->m_uiIndex;
+				pTopology->m_auiArcNode1[uiArc] = pArc->m_pNode1->m_uiIndex;
+				pTopology->m_afArcSpringCoef[uiArc] = pArc->m_fSpringCoef;
+				pTopology->m_afArcIdealLen[uiArc] = pArc->m_fIdealLen;
+				uiArc++;
+			}
+		}
+		pTopology->m_uiArcCount = uiArc;
+		pTopology->m_bValid = true;
+
+		topologyBuildAdjacency(pTopology, pSystem->m_Nodes.m_uiCount);
+	}
+}
+
+unsigned int nodeDegree(raaSystem* pSystem, unsigned int uiNode)
+{
+	if (pSystem && topologyAdjacency(pSystem) && uiNode < pSystem->m_Topology.m_uiNodeCount) return pSystem->m_Topology.m_auiOffset[uiNode + 1] - pSystem->m_Topology.m_auiOffset[uiNode];
 	return 0;
 }
 
-void addArc(raaSystem* pSystem, raaArc* pArc)
+bool updateAdjacency(raaSystem* pSystem)
+{
+	return pSystem && topologyAdjacency(pSystem);
+}
+
+const unsigned int* nodeNeighbours(raaSystem* pSystem, unsigned int uiNode, unsigned int &uiCount)
 {
-	if (pSystem && pArc) pushTail(&(pSystem->m_llArcs), initElement(new raaLinkedListElement, pArc, csg_uiArc));
+	uiCount = 0;
+	if (pSystem && topologyAdjacency(pSystem) && uiNode < pSystem->m_Topology.m_uiNodeCount)
+	{
+		uiCount = pSystem->m_Topology.m_auiOffset[uiNode + 1] - pSystem->m_Topology.m_auiOffset[uiNode];
+		return pSystem->m_Topology.m_auiNeighbour + pSystem->m_Topology.m_auiOffset[uiNode];
+	}
+	return 0;
 }
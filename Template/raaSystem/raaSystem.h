@@ -5,53 +5,243 @@
 #pragma comment(lib,"raaSystemR")
 #endif
 
+#include <stddef.h>
+#include <unordered_map>
 #include <raaLinkedList/raaLinkedList.h>
 #include <raaMaths/raaVector.h>
+#include "raaPool.h"
+#include "raaNameTable.h"
+#include "raaThreadPool.h"
 
-typedef struct _raaSystem
+const static unsigned int csg_uiInvalidIndex = 0xffffffff;
+const static unsigned int csg_uiSystemAlignment = 64; // cache line, also satisfies sse/avx load alignment
+const static unsigned int csg_uiNodeStoreMinCapacity = 256;
+const static unsigned int csg_uiNodeIdDirectSlack = 4096; // ids up to 2*count+slack are direct mapped, larger ids fall back to the hash
+
+// stable reference to a node or arc - a slot in the system's handle table plus the generation of the slot when the handle
+// was issued. Removing the node/arc bumps the generation so old handles resolve to 0 instead of dangling. {0,0} is never issued.
+typedef struct _raaHandle
 {
-	raaLinkedList m_llNodes;
-	raaLinkedList m_llArcs;
-} raaSystem;
+	unsigned int m_uiSlot;
+	unsigned int m_uiGeneration;
+} raaHandle;
+
+const static raaHandle csg_NullHandle = { 0, 0 };
 
+typedef struct _raaHandleTable
+{
+	void **m_apItem;
+	unsigned int *m_auiGeneration;
+	unsigned int *m_auiNextFree;
+	unsigned int m_uiCount;
+	unsigned int m_uiCapacity;
+	unsigned int m_uiFree; // head of the free slot list
+} raaHandleTable;
+
+struct _raaArc;
+
+// node record - cold attributes only, the physics state lives in the system node store at m_uiIndex and the name in the
+// system name table at m_uiName
 typedef struct _raaNode
 {
 	unsigned int m_uiId;
-	float m_afPosition[4];
+	unsigned int m_uiIndex;
 	float m_fMass;
 	unsigned int m_uiContinent;
 	unsigned int m_uiWorldSystem;
-	char m_acName[64];
-	float m_resultantForce[4];
-	float m_velocity[4];
+	unsigned int m_uiName;
 	float m_defaultPosition[4];
 	float m_worldSystemPosition[4];
+	raaHandle m_Handle;
+	raaLinkedListElement *m_pElement; // in the node list, if maintained
+	_raaArc *m_pArcs; // head of the chain of arcs using this node
 } raaNode;
 
+// structure of arrays node store - vectors are 4 floats per node, all arrays are aligned to csg_uiSystemAlignment and indexed by the dense node index
+typedef struct _raaNodeStore
+{
+	unsigned int m_uiCount;
+	unsigned int m_uiCapacity;
+	float *m_afPosition;
+	float *m_afVelocity;
+	float *m_afForce;
+	float *m_afInvMass; // 1/mass, 0 for immovable nodes
+	raaNode **m_apNode; // dense index -> node record
+} raaNodeStore;
+
+// id -> node lookup, direct mapped for the dense ids pajek files use with a hashed fallback for outliers
+typedef struct _raaNodeIdIndex
+{
+	raaNode **m_apDirect;
+	unsigned int m_uiDirectSize;
+	std::unordered_map<unsigned int, raaNode*> *m_pSparse;
+} raaNodeIdIndex;
+
 typedef struct _raaArc
 {
 	raaNode *m_pNode0;
 	raaNode *m_pNode1;
 	float m_fSpringCoef;
 	float m_fIdealLen;
+	unsigned int m_uiIndex; // dense arc index in the topology
+	raaHandle m_Handle;
+	raaLinkedListElement *m_pElement;
+	_raaArc *m_apNextArc[2]; // per node arc chains, [0] links the arcs of m_pNode0 and [1] those of m_pNode1
+	_raaArc *m_apLastArc[2];
 } raaArc;
 
+// index based arc topology, built from the arc list by buildTopology. Once built the arc arrays are kept current by
+// addArc/removeArc/removeNode, the adjacency is marked stale by any change and rebuilt on demand by the neighbour queries.
+typedef struct _raaTopology
+{
+	unsigned int m_uiNodeCount;
+	unsigned int m_uiArcCount;
+	unsigned int m_uiArcCapacity;
+
+	// arc arrays, one entry per arc, endpoints are dense node indices
+	unsigned int *m_auiArcNode0;
+	unsigned int *m_auiArcNode1;
+	float *m_afArcSpringCoef;
+	float *m_afArcIdealLen;
+	raaArc **m_apArc;
+
+	// compressed sparse row adjacency, each arc appears in the row of both of its nodes
+	unsigned int *m_auiOffset; // m_uiNodeCount+1 entries, row i is [m_auiOffset[i], m_auiOffset[i+1])
+	unsigned int *m_auiNeighbour;
+	unsigned int *m_auiNeighbourArc;
+	float *m_afSpringCoef;
+	float *m_afIdealLen;
+
+	bool m_bValid; // arc arrays
+	bool m_bAdjacencyValid;
+} raaTopology;
+
+typedef struct _raaSystem
+{
+	raaLinkedList m_llNodes; // compatibility view, only maintained if m_bNodeList is set
+	raaLinkedList m_llArcs;
+	raaNodeStore m_Nodes;
+	raaNodeIdIndex m_IdIndex;
+	raaTopology m_Topology;
+	raaNameTable m_Names;
+	raaHandleTable m_NodeHandles;
+	raaHandleTable m_ArcHandles;
+	raaPool m_NodePool; // owned node, arc and list element storage, released together by destroySystem/resetSystem
+	raaPool m_ArcPool;
+	raaPool m_ElementPool;
+	bool m_bNodeList;
+} raaSystem;
+
 const static unsigned int csg_uiNode = 1;
 const static unsigned int csg_uiArc = 2;
 
+// how mergeArcs combines the spring coefficients of parallel arcs, the ideal lengths are always averaged
+const static unsigned int csg_uiArcMergeSum = 1; // same force as the separate springs when their ideal lengths match
+const static unsigned int csg_uiArcMergeMax = 2;
+const static unsigned int csg_uiArcMergeMean = 3;
+
 typedef void (nodeFunction)(raaNode *pNode);
 typedef void (arcFunction)(raaArc *pArc);
 
-void initSystem(raaSystem *pSystem);
-raaNode* initNode(raaNode *pNode, unsigned int uiId, float *pfPosition, float fMass, const char *acName);
+void initSystem(raaSystem *pSystem, bool bNodeList=true);
+void destroySystem(raaSystem *pSystem);
+void resetSystem(raaSystem *pSystem); // empties the system but keeps its memory for the next load
+
+// nodes and arcs added to a system must be allocated here, they are owned by the system and released with it
+raaNode* allocNode(raaSystem *pSystem);
+raaArc* allocArc(raaSystem *pSystem);
+raaNode* initNode(raaNode *pNode, unsigned int uiId, float *pfPosition, float fMass);
 raaArc* initArc(raaArc *pArc, raaNode *pNode0, raaNode *pNode1, float fSpringCoef, float fIdealLen);
 
 void addNode(raaSystem *pSystem, raaNode *pNode);
 void addArc(raaSystem *pSystem, raaArc *pArc);
 
+// bulk load support - reserve before adding a known number of nodes, rebuild the id index in one pass after bulk changes
+void reserveNodes(raaSystem *pSystem, unsigned int uiCount);
+void buildNodeIdIndex(raaSystem *pSystem);
+
 raaNode* nodeById(raaSystem *pSystem, unsigned int uiId);
 
+// runtime insertion/removal - use addNode/addArc then keep m_Handle. Removing a node removes every arc using it.
+// Removal swaps the last node/arc into the freed dense index, so dense indices are not stable across removals - handles are.
+raaNode* nodeFromHandle(raaSystem *pSystem, raaHandle hNode);
+raaArc* arcFromHandle(raaSystem *pSystem, raaHandle hArc);
+bool removeNode(raaSystem *pSystem, raaHandle hNode);
+bool removeArc(raaSystem *pSystem, raaHandle hArc);
+
+// load time clean up - arcs joining the same pair of nodes (repeated or reciprocal) are merged into the first of them
+// using uiRule, returns the number of arcs removed
+unsigned int mergeArcs(raaSystem *pSystem, unsigned int uiRule);
+
+// access to the node store for a node record
+float* nodePosition(raaSystem *pSystem, raaNode *pNode);
+float* nodeVelocity(raaSystem *pSystem, raaNode *pNode);
+float* nodeForce(raaSystem *pSystem, raaNode *pNode);
+void nodeSetMass(raaSystem *pSystem, raaNode *pNode, float fMass);
+
+// node names are interned in the system name table, identical names share one copy
+void nodeSetName(raaSystem *pSystem, raaNode *pNode, const char *acName);
+const char* nodeName(raaSystem *pSystem, raaNode *pNode);
+
+// topology - build after load, neighbour queries need a valid topology
+void buildTopology(raaSystem *pSystem);
+unsigned int nodeDegree(raaSystem *pSystem, unsigned int uiNode);
+const unsigned int* nodeNeighbours(raaSystem *pSystem, unsigned int uiNode, unsigned int &uiCount);
+bool updateAdjacency(raaSystem *pSystem); // rebuilds the csr adjacency if arcs changed, false without a valid topology
+
 void visitNodes(raaSystem *pSystem, nodeFunction* pNodeFunction);
 void visitArcs(raaSystem *pSystem, arcFunction* pArcFunction);
 
+// inlinable visitors, fFunction is any callable taking a raaNode* or raaArc* (eg a capturing lambda)
+template<class F> void visitNodes(raaSystem *pSystem, F fFunction)
+{
+	if (pSystem)
+	{
+		raaNode **apNode = pSystem->m_Nodes.m_apNode;
+		for (unsigned int i = 0; i < pSystem->m_Nodes.m_uiCount; i++) fFunction(apNode[i]);
+	}
+}
+
+template<class F> void visitArcs(raaSystem *pSystem, F fFunction)
+{
+	if (pSystem)
+	{
+		raaLinkedList *pList = &(pSystem->m_llArcs);
+		for (unsigned int i = 0; i < pList->m_uiChunks; i++)
+		{
+			raaLinkedListChunk *pChunk = pList->m_apChunk[i];
+			for (unsigned int j = 0; j < pChunk->m_uiCount; j++) if (pChunk->m_apElement[j]->m_pData) fFunction((raaArc*)pChunk->m_apElement[j]->m_pData);
+		}
+	}
+}
+
+// parallel visitors, the traversal is split across the pool (default pool if 0) in chunks of about uiChunk items.
+// fFunction is called concurrently so it must only write state belonging to the node or arc it is given.
+template<class F> void visitNodesParallel(raaSystem *pSystem, F fFunction, unsigned int uiChunk=csg_uiThreadPoolDefaultChunk, raaThreadPool *pPool=0)
+{
+	if (pSystem)
+	{
+		raaNode **apNode = pSystem->m_Nodes.m_apNode;
+		threadPoolFor(pPool ? pPool : threadPoolDefault(), pSystem->m_Nodes.m_uiCount, uiChunk, [apNode, &fFunction](unsigned int uiBegin, unsigned int uiEnd, unsigned int)
+		{
+			for (unsigned int i = uiBegin; i < uiEnd; i++) fFunction(apNode[i]);
+		});
+	}
+}
+
+template<class F> void visitArcsParallel(raaSystem *pSystem, F fFunction, unsigned int uiChunk=csg_uiThreadPoolDefaultChunk, raaThreadPool *pPool=0)
+{
+	if (pSystem)
+	{
+		raaLinkedListChunk **apChunk = pSystem->m_llArcs.m_apChunk;
+		unsigned int uiListChunks = uiChunk > csg_uiListChunkSize ? uiChunk / csg_uiListChunkSize : 1;
+		threadPoolFor(pPool ? pPool : threadPoolDefault(), pSystem->m_llArcs.m_uiChunks, uiListChunks, [apChunk, &fFunction](unsigned int uiBegin, unsigned int uiEnd, unsigned int)
+		{
+			for (unsigned int i = uiBegin; i < uiEnd; i++)
+				for (unsigned int j = 0; j < apChunk[i]->m_uiCount; j++) if (apChunk[i]->m_apElement[j]->m_pData) fFunction((raaArc*)apChunk[i]->m_apElement[j]->m_pData);
+		});
+	}
+}
 
+void* systemAlignedAlloc(size_t uiSize);
+void systemAlignedFree(void *pMem);
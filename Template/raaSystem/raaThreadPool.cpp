@@ -0,0 +1,132 @@
+#include "stdafx.h"
+#include <stdlib.h>
+#include "raaThreadPool.h"
+
+static raaThreadPool *gs_pDefaultPool = 0;
+static std::once_flag gs_DefaultPoolOnce;
+
+static void threadPoolWork(raaThreadPool *pPool, unsigned int uiThread)
+{
+	while (true)
+	{
+		unsigned int uiBegin = pPool->m_uiNext.fetch_add(pPool->m_uiChunk);
+		if (uiBegin >= pPool->m_uiCount) break;
+		unsigned int uiEnd = pPool->m_uiCount - uiBegin > pPool->m_uiChunk ? uiBegin + pPool->m_uiChunk : pPool->m_uiCount;
+		pPool->m_pFunction(pPool->m_pData, uiBegin, uiEnd, uiThread);
+	}
+}
+
+static void threadPoolWorker(raaThreadPool *pPool, unsigned int uiThread)
+{
+	unsigned int uiGeneration = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(pPool->m_Mutex);
+			pPool->m_cvStart.wait(lock, [&] { return pPool->m_bQuit || pPool->m_uiGeneration != uiGeneration; });
+			if (pPool->m_bQuit) return;
+			uiGeneration = pPool->m_uiGeneration;
+		}
+
+		threadPoolWork(pPool, uiThread);
+
+		{
+			std::lock_guard<std::mutex> lock(pPool->m_Mutex);
+			if (!--pPool->m_uiBusy) pPool->m_cvDone.notify_one();
+		}
+	}
+}
+
+static void threadPoolDestroyDefault()
+{
+	threadPoolDestroy(gs_pDefaultPool);
+	delete gs_pDefaultPool;
+	gs_pDefaultPool = 0;
+}
+
+void threadPoolInit(raaThreadPool* pPool, unsigned int uiThreads)
+{
+	if (pPool)
+	{
+		if (!uiThreads) uiThreads = std::thread::hardware_concurrency();
+		if (!uiThreads) uiThreads = 1;
+
+		pPool->m_uiThreads = uiThreads;
+		pPool->m_uiGeneration = 0;
+		pPool->m_uiBusy = 0;
+		pPool->m_bQuit = false;
+		pPool->m_pFunction = 0;
+		pPool->m_pData = 0;
+		pPool->m_uiCount = 0;
+		pPool->m_uiChunk = 1;
+		pPool->m_uiNext = 0;
+		pPool->m_aWorkers = uiThreads > 1 ? new std::thread[uiThreads - 1] : 0;
+		for (unsigned int i = 1; i < uiThreads; i++) pPool->m_aWorkers[i - 1] = std::thread(threadPoolWorker, pPool, i);
+	}
+}
+
+void threadPoolDestroy(raaThreadPool* pPool)
+{
+	if (pPool && pPool->m_aWorkers)
+	{
+		{
+			std::lock_guard<std::mutex> lock(pPool->m_Mutex);
+			pPool->m_bQuit = true;
+		}
+		pPool->m_cvStart.notify_all();
+
+		for (unsigned int i = 1; i < pPool->m_uiThreads; i++) pPool->m_aWorkers[i - 1].join();
+		delete[] pPool->m_aWorkers;
+		pPool->m_aWorkers = 0;
+		pPool->m_uiThreads = 1;
+	}
+}
+
+void threadPoolRun(raaThreadPool* pPool, unsigned int uiCount, unsigned int uiChunk, raaRangeFunction* pFunction, void* pData)
+{
+	if (pFunction && uiCount)
+	{
+		if (!uiChunk) uiChunk = 1;
+
+		// not worth waking anyone for a single chunk
+		if (!pPool || pPool->m_uiThreads < 2 || uiCount <= uiChunk)
+		{
+			pFunction(pData, 0, uiCount, 0);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(pPool->m_Mutex);
+			pPool->m_pFunction = pFunction;
+			pPool->m_pData = pData;
+			pPool->m_uiCount = uiCount;
+			pPool->m_uiChunk = uiChunk;
+			pPool->m_uiNext = 0;
+			pPool->m_uiBusy = pPool->m_uiThreads - 1;
+			pPool->m_uiGeneration++;
+		}
+		pPool->m_cvStart.notify_all();
+
+		threadPoolWork(pPool, 0);
+
+		std::unique_lock<std::mutex> lock(pPool->m_Mutex);
+		pPool->m_cvDone.wait(lock, [pPool] { return !pPool->m_uiBusy; });
+	}
+}
+
+unsigned int threadPoolThreads(raaThreadPool* pPool)
+{
+	return pPool ? pPool->m_uiThreads : 1;
+}
+
+raaThreadPool* threadPoolDefault()
+{
+	std::call_once(gs_DefaultPoolOnce, []
+	{
+		gs_pDefaultPool = new raaThreadPool;
+		threadPoolInit(gs_pDefaultPool);
+		atexit(threadPoolDestroyDefault);
+	});
+	return gs_pDefaultPool;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#ifdef _DEBUG
+#pragma comment(lib,"raaSystemD")
+#else
+#pragma comment(lib,"raaSystemR")
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// fork/join pool for data parallel loops. The calling thread works as thread 0 alongside the workers and a run returns when
+// the whole range is done. Ranges are handed out in chunks of the given size. Runs must not be nested or issued concurrently.
+
+const static unsigned int csg_uiThreadPoolDefaultChunk = 1024;
+
+typedef void (raaRangeFunction)(void *pData, unsigned int uiBegin, unsigned int uiEnd, unsigned int uiThread);
+
+typedef struct _raaThreadPool
+{
+	unsigned int m_uiThreads; // including the calling thread
+	std::thread *m_aWorkers;
+	std::mutex m_Mutex;
+	std::condition_variable m_cvStart;
+	std::condition_variable m_cvDone;
+	unsigned int m_uiGeneration;
+	unsigned int m_uiBusy;
+	bool m_bQuit;
+
+	raaRangeFunction *m_pFunction;
+	void *m_pData;
+	unsigned int m_uiCount;
+	unsigned int m_uiChunk;
+	std::atomic<unsigned int> m_uiNext;
+} raaThreadPool;
+
+void threadPoolInit(raaThreadPool *pPool, unsigned int uiThreads=0); // 0 -> one thread per hardware thread
+void threadPoolDestroy(raaThreadPool *pPool);
+void threadPoolRun(raaThreadPool *pPool, unsigned int uiCount, unsigned int uiChunk, raaRangeFunction *pFunction, void *pData);
+unsigned int threadPoolThreads(raaThreadPool *pPool);
+raaThreadPool* threadPoolDefault(); // shared pool, created on first use
+
+template<class F> void threadPoolTrampoline(void *pData, unsigned int uiBegin, unsigned int uiEnd, unsigned int uiThread)
+{
+	(*(F*)pData)(uiBegin, uiEnd, uiThread);
+}
+
+// fFunction(uiBegin, uiEnd, uiThread) is called for consecutive sub ranges of [0, uiCount)
+template<class F> void threadPoolFor(raaThreadPool *pPool, unsigned int uiCount, unsigned int uiChunk, F fFunction)
+{
+	threadPoolRun(pPool, uiCount, uiChunk, threadPoolTrampoline<F>, &fFunction);
+}
+
+template<class F> void parallelFor(unsigned int uiCount, unsigned int uiChunk, F fFunction)
+{
+	threadPoolFor(threadPoolDefault(), uiCount, uiChunk, fFunction);
+}
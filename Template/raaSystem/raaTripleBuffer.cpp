@@ -0,0 +1,54 @@
+#include "stdafx.h"
+#include <string.h>
+#include "raaSystem.h"
+#include "raaTripleBuffer.h"
+
+void tripleBufferInit(raaTripleBuffer *pBuffer, unsigned int uiFloats)
+{
+	if (pBuffer)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			pBuffer->m_afBuffer[i] = (float*)systemAlignedAlloc(sizeof(float) * (uiFloats ? uiFloats : 1));
+			memset(pBuffer->m_afBuffer[i], 0, sizeof(float) * uiFloats);
+		}
+		pBuffer->m_uiFloats = uiFloats;
+		pBuffer->m_uiWrite = 0;
+		pBuffer->m_uiShared = 1;
+		pBuffer->m_uiRead = 2;
+	}
+}
+
+void tripleBufferDestroy(raaTripleBuffer *pBuffer)
+{
+	if (pBuffer)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			systemAlignedFree(pBuffer->m_afBuffer[i]);
+			pBuffer->m_afBuffer[i] = 0;
+		}
+		pBuffer->m_uiFloats = 0;
+	}
+}
+
+float* tripleBufferWrite(raaTripleBuffer *pBuffer)
+{
+	return pBuffer ? pBuffer->m_afBuffer[pBuffer->m_uiWrite] : 0;
+}
+
+// release so the consumer sees the filled array, acquire so the producer does not overwrite what the consumer last read
+void tripleBufferPublish(raaTripleBuffer *pBuffer)
+{
+	if (pBuffer) pBuffer->m_uiWrite = pBuffer->m_uiShared.exchange(pBuffer->m_uiWrite | csg_uiTripleBufferFresh, std::memory_order_acq_rel) & csg_uiTripleBufferIndex;
+}
+
+const float* tripleBufferRead(raaTripleBuffer *pBuffer)
+{
+	if (!pBuffer) return 0;
+
+	if (pBuffer->m_uiShared.load(std::memory_order_relaxed) & csg_uiTripleBufferFresh)
+		pBuffer->m_uiRead = pBuffer->m_uiShared.exchange(pBuffer->m_uiRead, std::memory_order_acq_rel) & csg_uiTripleBufferIndex;
+
+	return pBuffer->m_afBuffer[pBuffer->m_uiRead];
+}
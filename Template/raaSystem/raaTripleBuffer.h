@@ -0,0 +1,35 @@
+#pragma once
+#ifdef _DEBUG
+#pragma comment(lib,"raaSystemD")
+#else
+#pragma comment(lib,"raaSystemR")
+#endif
+
+#include <atomic>
+
+// lock free triple buffer of float arrays between one producer and one consumer thread. The producer fills its write buffer
+// and publishes it by swapping it with the shared buffer, the consumer swaps its read buffer with the shared one when a
+// fresh one is there. Neither side ever waits for the other, the consumer always has the latest complete array and the
+// producer may publish any number of times between reads.
+
+const static unsigned int csg_uiTripleBufferIndex = 3; // index bits of m_uiShared
+const static unsigned int csg_uiTripleBufferFresh = 4; // m_uiShared holds a buffer published since the last read
+
+typedef struct _raaTripleBuffer
+{
+	float *m_afBuffer[3];
+	unsigned int m_uiFloats;
+	std::atomic<unsigned int> m_uiShared; // buffer between the two sides, with csg_uiTripleBufferFresh
+	unsigned int m_uiWrite; // producer side only
+	unsigned int m_uiRead; // consumer side only
+} raaTripleBuffer;
+
+void tripleBufferInit(raaTripleBuffer *pBuffer, unsigned int uiFloats); // all three buffers zeroed
+void tripleBufferDestroy(raaTripleBuffer *pBuffer);
+
+// producer - the buffer to fill, then publish it, after which tripleBufferWrite gives another
+float* tripleBufferWrite(raaTripleBuffer *pBuffer);
+void tripleBufferPublish(raaTripleBuffer *pBuffer);
+
+// consumer - the latest published buffer, valid until the next call
+const float* tripleBufferRead(raaTripleBuffer *pBuffer);
@@ -25,7 +25,7 @@ void killFont()
 	glDeleteLists(g_uiFontBase, 256);
 }
 
-void outlinePrint(char* acString, bool bCentre)
+void outlinePrint(const char* acString, bool bCentre)
 {
 	if(acString && strlen(acString))
 	{
@@ -7,5 +7,5 @@
 
 void buildFont();
 void killFont();
-void outlinePrint(char* acString, bool bCentre=true);
+void outlinePrint(const char* acString, bool bCentre=true);
  
\ No newline at end of file